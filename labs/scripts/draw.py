@@ -1,11 +1,22 @@
 from matplotlib import pyplot as plt
+import json
 import os
 
 prefix = 'brchPredict-'
 suffix = '.txt'
+json_suffix = '.json'
+schema_version = 1
 
 
 def parse_one(name: str):
+    # prefer structured results of `-format json`
+    if os.path.exists(f"{prefix}{name}{json_suffix}"):
+        with open(f"{prefix}{name}{json_suffix}") as f:
+            doc = json.load(f)
+        assert doc['schema_version'] == schema_version, f"unsupported schema {doc['schema_version']}"
+        if len(doc['results']) == 0:
+            return None
+        return [r['predictor'] for r in doc['results']], [r['precision'] * 100 for r in doc['results']]
     with open(f"{prefix}{name}{suffix}") as f:
         lines = f.readlines()
         tests = []
@@ -43,8 +54,8 @@ def draw_ghr(data: dict):
 
 
 def run():
-    files = [f for f in os.listdir() if f.startswith(prefix) and f.endswith(suffix)]
-    test_names = [f[len(prefix):-len(suffix)] for f in files]
+    files = [f for f in os.listdir() if f.startswith(prefix) and (f.endswith(suffix) or f.endswith(json_suffix))]
+    test_names = sorted(set(f[len(prefix):f.rfind('.')] for f in files))
     print("test names:", test_names)
     data = {}
     for name in test_names:
@@ -1,4 +1,5 @@
 from matplotlib import pyplot as plt
+import json
 import os
 from typing import *
 from operator import itemgetter
@@ -6,7 +7,26 @@ import numpy as np
 
 prefix = 'cacheModels-'
 suffix = '.txt'
+json_suffix = '.json'
 data_dir = "data/cacheModel/"
+schema_version = 1
+
+
+def parse_json(base: str, name: str):
+    """Same rows as parse_one, from the structured results of `-format json`"""
+    with open(f"{base}/{prefix}{name}{json_suffix}") as f:
+        doc = json.load(f)
+    assert doc['schema_version'] == schema_version, f"unsupported schema {doc['schema_version']}"
+    data = []
+    for r in doc['results']:
+        if 'sets_log' in r:
+            args = [r['sets_log'], r['block_size_log'], r['asso']]
+            method = r['replacement']
+        else:
+            args = [r['block_num'], r['block_size_log']]
+            method = None
+        data.append([r['kind'], args, method, r['miss_rate'] * 100, r['capacity_kib']])
+    return data
 
 
 def parse_one(base: str, name: str):
@@ -189,13 +209,17 @@ def draw_algo(data: dict):
 
 def load(pathname: str = '.', include_coremark: bool = True):
     files = [f for f in os.listdir(data_dir + pathname) if f.startswith(prefix) and
-             f.endswith(suffix) and
+             (f.endswith(suffix) or f.endswith(json_suffix)) and
              (('coremark' not in f) if not include_coremark else True)]
-    test_names = [f[len(prefix):-len(suffix)] for f in files]
+    test_names = sorted(set(f[len(prefix):f.rfind('.')] for f in files))
     # print(f"dir: {pathname} test names: {test_names}")
     data = {}
     for name in test_names:
-        d = parse_one(data_dir + pathname, name)
+        # prefer structured results over the markdown table
+        if os.path.exists(f"{data_dir + pathname}/{prefix}{name}{json_suffix}"):
+            d = parse_json(data_dir + pathname, name)
+        else:
+            d = parse_one(data_dir + pathname, name)
         if len(d) > 0:
             data[name] = d
     # draw_ghr(data)
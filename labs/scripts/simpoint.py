@@ -0,0 +1,134 @@
+"""
+Pick SimPoint representative intervals from basic block vectors.
+
+Usage: python simpoint.py bbv-gcc.T0.bb [-k 30] [--seed 1] [-o gcc]
+
+Writes <out>.simpoints ("interval cluster") and <out>.weights ("weight cluster"),
+which are loaded by brchPredict/cacheModel with -simpoints/-weights.
+"""
+import argparse
+import numpy as np
+from typing import *
+
+projected_dims = 15
+
+
+def parse_bbv(filename: str) -> List[Dict[int, int]]:
+    vectors = []
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith('T'):
+                continue
+            v = {}
+            for item in line[1:].split():
+                _, bb, count = item.split(':')
+                v[int(bb)] = int(count)
+            vectors.append(v)
+    return vectors
+
+
+def project(vectors: List[Dict[int, int]], dims: int, rng: np.random.Generator) -> np.ndarray:
+    """Normalize every vector to sum 1 and randomly project it to `dims` dimensions"""
+    n_bb = max((max(v.keys()) for v in vectors if v), default=0) + 1
+    projection = rng.uniform(-1, 1, (n_bb, dims))
+    data = np.zeros((len(vectors), dims))
+    for i, v in enumerate(vectors):
+        total = sum(v.values())
+        if total == 0:
+            continue
+        for bb, count in v.items():
+            data[i] += projection[bb] * (count / total)
+    return data
+
+
+def kmeans(data: np.ndarray, k: int, rng: np.random.Generator, iterations: int = 100):
+    # k-means++ seeding
+    centers = [data[rng.integers(len(data))]]
+    for _ in range(1, k):
+        d = np.min([np.sum((data - c) ** 2, axis=1) for c in centers], axis=0)
+        if d.sum() == 0:
+            break
+        centers.append(data[rng.choice(len(data), p=d / d.sum())])
+    centers = np.array(centers)
+    labels = np.zeros(len(data), dtype=int)
+    for it in range(iterations):
+        dist = np.sum((data[:, None, :] - centers[None, :, :]) ** 2, axis=2)
+        new_labels = np.argmin(dist, axis=1)
+        if it > 0 and np.array_equal(new_labels, labels):
+            break
+        labels = new_labels
+        for c in range(len(centers)):
+            members = data[labels == c]
+            if len(members) > 0:
+                centers[c] = members.mean(axis=0)
+    return centers, labels
+
+
+def bic(data: np.ndarray, centers: np.ndarray, labels: np.ndarray) -> float:
+    """Bayesian information criterion of a clustering, as in X-means"""
+    r, m = data.shape
+    k = len(centers)
+    if r <= k:
+        return -np.inf
+    distortion = np.sum((data - centers[labels]) ** 2)
+    variance = max(distortion / (r - k), 1e-12)
+    likelihood = 0.0
+    for c in range(k):
+        rc = np.sum(labels == c)
+        if rc == 0:
+            continue
+        likelihood += rc * np.log(rc) - rc * np.log(r) \
+            - rc / 2 * np.log(2 * np.pi) - rc * m / 2 * np.log(variance) - (rc - k) / 2
+    params = (k - 1) + m * k + 1
+    return likelihood - params / 2 * np.log(r)
+
+
+def pick(data: np.ndarray, max_k: int, seed: int, threshold: float = 0.9):
+    """Smallest k whose BIC reaches `threshold` of the observed BIC range"""
+    rng = np.random.default_rng(seed)
+    runs = []
+    for k in range(1, min(max_k, len(data)) + 1):
+        centers, labels = kmeans(data, k, rng)
+        runs.append((k, bic(data, centers, labels), centers, labels))
+    scores = [r[1] for r in runs]
+    lo, hi = min(scores), max(scores)
+    for k, score, centers, labels in runs:
+        if score >= lo + threshold * (hi - lo):
+            return centers, labels
+    return runs[-1][2], runs[-1][3]
+
+
+def run():
+    parser = argparse.ArgumentParser(description='SimPoint interval selection')
+    parser.add_argument('bbv', help='basic block vector file from bbvProfile')
+    parser.add_argument('-k', '--max-k', type=int, default=30, help='maximum number of clusters')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('-o', '--output', default=None, help='output prefix, derived from the bbv file by default')
+    args = parser.parse_args()
+
+    vectors = parse_bbv(args.bbv)
+    assert len(vectors) > 0, f"no intervals in {args.bbv}"
+    data = project(vectors, projected_dims, np.random.default_rng(args.seed))
+    centers, labels = pick(data, args.max_k, args.seed)
+
+    output = args.output
+    if output is None:
+        output = args.bbv[:-len('.bb')] if args.bbv.endswith('.bb') else args.bbv
+    with open(output + '.simpoints', 'w') as fp, open(output + '.weights', 'w') as fw:
+        cluster = 0
+        for c in range(len(centers)):
+            members = np.where(labels == c)[0]
+            if len(members) == 0:
+                continue
+            # The interval closest to the centroid represents the cluster
+            rep = members[np.argmin(np.sum((data[members] - centers[c]) ** 2, axis=1))]
+            fp.write(f"{rep} {cluster}\n")
+            fw.write(f"{len(members) / len(data):.6f} {cluster}\n")
+            print(f"cluster {cluster}: interval {rep}, weight {len(members) / len(data):.4f}")
+            cluster += 1
+    print(f"{cluster} simulation points from {len(vectors)} intervals, written to {output}.simpoints/.weights")
+
+
+if __name__ == '__main__':
+    run()
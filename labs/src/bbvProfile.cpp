@@ -0,0 +1,168 @@
+//
+// Basic block vector profiler for SimPoint.
+//
+// Emits one basic block vector per interval of executed instructions, in the
+// SimPoint "T:id:count" format, to bbv-<program>.T<thread>.bb, and the basic
+// block table to bbv-<program>.bbmap.
+// Cluster the vectors with scripts/simpoint.py.
+//
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "pin.H"
+
+using namespace std;
+
+typedef unsigned int UINT32;
+typedef unsigned long int UINT64;
+
+KNOB<UINT64> KnobInterval(KNOB_MODE_WRITEONCE, "pintool", "interval", "10000000", "instructions per interval");
+KNOB<string> KnobOutputPrefix(KNOB_MODE_WRITEONCE, "pintool", "o", "",
+                              "output file prefix, bbv-<program> by default");
+
+static string prefix;
+static UINT64 interval_size;
+
+class BasicBlockInfo {
+public:
+  ADDRINT addr;
+  UINT32 num_ins;
+  string image;
+};
+
+// Basic block ids are assigned in instrumentation order, guarded by the client lock
+static unordered_map<ADDRINT, UINT32> bbl_ids;
+static vector<BasicBlockInfo> bbl_info;
+
+// Per-thread interval state, lives in TLS like inscount_tls
+class thread_data_t {
+public:
+  UINT64 count = 0;             // Instructions in the current interval
+  UINT64 intervals = 0;         // Emitted intervals
+  vector<UINT64> bbv;           // Instructions executed per basic block in the current interval
+  ofstream out;
+};
+
+static TLS_KEY tls_key = INVALID_TLS_KEY;
+
+static thread_data_t *getThreadData(THREADID tid) {
+  return static_cast<thread_data_t *>(PIN_GetThreadData(tls_key, tid));
+}
+
+// Emit the vector of the current interval
+static VOID emitInterval(thread_data_t *tdata) {
+  tdata->out << "T";
+  for (size_t i = 0; i < tdata->bbv.size(); i++) {
+    if (!tdata->bbv[i]) continue;
+    // SimPoint ids start from 1
+    tdata->out << ":" << i + 1 << ":" << tdata->bbv[i] << " ";
+    tdata->bbv[i] = 0;
+  }
+  tdata->out << endl;
+  tdata->count = 0;
+  tdata->intervals++;
+}
+
+// This function is called before every block
+static ADDRINT PIN_FAST_ANALYSIS_CALL countBbl(UINT32 id, UINT32 num_ins, THREADID tid) {
+  auto tdata = getThreadData(tid);
+  if (id >= tdata->bbv.size()) tdata->bbv.resize((id + 1) * 2, 0);
+  tdata->bbv[id] += num_ins;
+  tdata->count += num_ins;
+  return tdata->count >= interval_size;
+}
+
+static VOID intervalEnd(THREADID tid) {
+  emitInterval(getThreadData(tid));
+}
+
+VOID ThreadStart(THREADID tid, CONTEXT *ctxt, INT32 flags, VOID *v) {
+  auto tdata = new thread_data_t;
+  auto filename = prefix + ".T" + decstr(tid) + ".bb";
+  tdata->out.open(filename.c_str());
+  if (!tdata->out.is_open() || PIN_SetThreadData(tls_key, tdata, tid) == FALSE) {
+    cerr << "Cannot start profiling thread " << tid << endl;
+    PIN_ExitProcess(1);
+  }
+}
+
+VOID ThreadFini(THREADID tid, const CONTEXT *ctxt, INT32 code, VOID *v) {
+  auto tdata = getThreadData(tid);
+  // The last interval is shorter, keep it so that weights cover the whole run
+  if (tdata->count) emitInterval(tdata);
+  tdata->out.close();
+  delete tdata;
+}
+
+// Pin calls this function every time a new trace is encountered
+VOID Trace(TRACE trace, VOID *v) {
+  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    auto addr = BBL_Address(bbl);
+    auto it = bbl_ids.find(addr);
+    UINT32 id;
+    if (it == bbl_ids.end()) {
+      id = (UINT32) bbl_info.size();
+      bbl_ids[addr] = id;
+      IMG img = IMG_FindByAddress(addr);
+      bbl_info.push_back({addr, BBL_NumIns(bbl), IMG_Valid(img) ? IMG_Name(img) : string("?")});
+    } else {
+      id = it->second;
+    }
+    BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) countBbl, IARG_FAST_ANALYSIS_CALL,
+                     IARG_UINT32, id, IARG_UINT32, BBL_NumIns(bbl), IARG_THREAD_ID, IARG_END);
+    BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) intervalEnd, IARG_THREAD_ID, IARG_END);
+  }
+}
+
+// This function is called when the application exits
+VOID Fini(INT32 code, VOID *v) {
+  ofstream map_file((prefix + ".bbmap").c_str());
+  map_file.setf(ios::showbase);
+  for (size_t i = 0; i < bbl_info.size(); i++) {
+    auto &b = bbl_info[i];
+    map_file << dec << i + 1 << " " << hex << b.addr << " " << dec << b.num_ins << " " << b.image << endl;
+  }
+  map_file.close();
+  cerr << "BBV profile: " << bbl_info.size() << " basic blocks, written to " << prefix << ".*" << endl;
+}
+
+INT32 Usage() {
+  cerr << "This tool collects basic block vectors for SimPoint" << endl;
+  cerr << endl << KNOB_BASE::StringKnobSummary() << endl;
+  return -1;
+}
+
+int main(int argc, char *argv[]) {
+  // Initialize pin
+  if (PIN_Init(argc, argv)) return Usage();
+
+  prefix = KnobOutputPrefix.Value();
+  if (prefix.empty()) {
+    auto last_arg = string(argv[argc - 1]);
+    if (last_arg.find('/') != string::npos) {
+      last_arg = last_arg.substr(last_arg.rfind('/') + 1);
+    }
+    prefix = string("bbv-") + last_arg;
+  }
+  interval_size = KnobInterval.Value();
+  cerr << "BBV output prefix: " << prefix << ", interval: " << interval_size << endl;
+
+  // Obtain a key for TLS storage
+  tls_key = PIN_CreateThreadDataKey(nullptr);
+  if (tls_key == INVALID_TLS_KEY) {
+    cerr << "number of already allocated keys reached the MAX_CLIENT_TLS_KEYS limit" << endl;
+    PIN_ExitProcess(1);
+  }
+
+  PIN_AddThreadStartFunction(ThreadStart, nullptr);
+  PIN_AddThreadFiniFunction(ThreadFini, nullptr);
+  TRACE_AddInstrumentFunction(Trace, nullptr);
+  PIN_AddFiniFunction(Fini, nullptr);
+
+  // Start the program, never returns
+  PIN_StartProgram();
+
+  return 0;
+}
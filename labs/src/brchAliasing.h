@@ -0,0 +1,143 @@
+//
+// Aliasing of the counter tables of every predictor in BP[].
+//
+// Every table a predictor exposes through monitorTables() gets a monitor that
+// keeps, per entry, the last branch that trained it and a 64-bit sketch of
+// all of them (one bit per pc hash), next to an interference-free shadow: a
+// private counter for every (pc, entry) pair, trained like the table. An
+// update of an entry last trained by another branch is an aliased access.
+// When the entry and the private counter disagree, interference decided the
+// prediction (Young, Gloy and Smith):
+//   constructive  the shared entry was right, the private counter wrong
+//   destructive   the shared entry was wrong, the private counter right
+// Destructive minus constructive is what the table size or index hash costs
+// in mispredictions. The shadow grows with the (pc, entry) pairs seen, so
+// this is a mode for analysis runs.
+//
+// Predictions are those of the counters when they are trained, the ones of
+// predict() unless -delay is set. TAGE, perceptron and gskew tables are not
+// monitored. Fed from the updates, so it works with -parallel. Counts are not
+// weighted by SimPoint.
+//
+#ifndef ARCH_LABS_BRCH_ALIASING_H
+#define ARCH_LABS_BRCH_ALIASING_H
+
+#include <unordered_map>
+#include "brchPredict.h"
+
+class AliasingMonitor : public TableMonitor {
+  const size_t m_entries_log;
+  const UINT8 m_max;
+  const UINT8 m_init;
+  vector<UINT32> m_last;                 // Tag of the pc that trained each entry last, 0 if none
+  vector<UINT64> m_sketch;               // Bit (hash >> 58) of every pc that trained each entry
+  unordered_map<UINT64, UINT8> m_shadow; // Private counters by pc hash ^ entry
+
+  // Odd multiplier, so distinct pcs keep distinct hashes
+  static UINT64 pcHash(ADDRINT pc) { return (UINT64) pc * 0x9e3779b97f4a7c15ULL; }
+
+public:
+  const string name;
+  UINT64 accesses = 0;
+  UINT64 aliased = 0;
+  UINT64 constructive = 0;
+  UINT64 destructive = 0;
+
+  AliasingMonitor(const string &name, size_t entries_log, size_t scnt_width)
+          : m_entries_log(entries_log), m_max((UINT8) ((1u << scnt_width) - 1)),
+            m_init((UINT8) ((1u << scnt_width) / 2)), m_last((size_t) 1 << entries_log, 0),
+            m_sketch((size_t) 1 << entries_log, 0), name(name) {}
+
+  void access(size_t index, ADDRINT pc, bool taken, UINT8 counter) override {
+    UINT64 h = pcHash(pc);
+    UINT32 tag = (UINT32) (h >> 32) | 1;
+    accesses++;
+    if (m_last[index] && m_last[index] != tag) aliased++;
+    m_last[index] = tag;
+    m_sketch[index] |= (UINT64) 1 << (h >> 58);
+    UINT8 &own = m_shadow.emplace(h ^ index, m_init).first->second;
+    bool shared_taken = counter >= m_init, own_taken = own >= m_init;
+    if (shared_taken != own_taken) (shared_taken == taken ? constructive : destructive)++;
+    if (taken && own < m_max) own++;
+    if (!taken && own > 0) own--;
+  }
+
+  size_t entriesLog() const { return m_entries_log; }
+
+  /**
+   * Entries trained at least once and by two branches at least, and the mean
+   * branches of a trained entry, by linear counting of the sketches
+   */
+  void entries(UINT64 &used, UINT64 &shared, double &branches) const {
+    used = shared = 0;
+    double sum = 0;
+    for (auto s: m_sketch) {
+      if (!s) continue;
+      int bits = __builtin_popcountll(s);
+      used++;
+      shared += bits > 1 ? 1 : 0;
+      sum += bits == 1 ? 1 : bits == 64 ? 64 * log(64.0) : -64 * log(1 - bits / 64.0);
+    }
+    branches = used ? sum / (double) used : 0;
+  }
+};
+
+class AliasingReport : public TableMonitorFactory {
+  vector<AliasingMonitor *> m_tables[TEST_SIZE_MAX];
+  int m_current = -1;
+  bool m_enabled = false;
+
+public:
+  bool enabled() const { return m_enabled; }
+
+  TableMonitor *create(const string &name, size_t entries_log, size_t scnt_width) override {
+    auto m = new AliasingMonitor(name, entries_log, scnt_width);
+    m_tables[m_current].push_back(m);
+    return m;
+  }
+
+  // Monitor the tables of every predictor now in BP[]
+  void start() {
+    m_enabled = true;
+    for (m_current = 0; m_current < TEST_SIZE_MAX; m_current++)
+      if (BP[m_current]) BP[m_current]->monitorTables(*this);
+  }
+
+  /**
+   * Print the aliasing and interference of every monitored table of every
+   * predictor, and add them to rows
+   * @param predictors Indices to report
+   */
+  void report(ostream &out, vector<ResultRecord> &rows, const vector<int> &predictors) const {
+    if (!m_enabled) return;
+    for (int i: predictors) {
+      for (auto t: m_tables[i]) {
+        UINT64 used, shared;
+        double branches;
+        t->entries(used, shared, branches);
+        double n = t->accesses ? (double) t->accesses : 1;
+        double used_share = (double) used / (double) ((UINT64) 1 << t->entriesLog());
+        out << "aliasing[" << i << "] " << t->name << ": " << 100 * t->aliased / n << "% of accesses aliased, "
+            << 100 * used_share << "% of entries used, " << 100 * (used ? (double) shared / (double) used : 0)
+            << "% of them shared, " << branches << " branches per entry; interference constructive "
+            << 100 * t->constructive / n << "%, destructive " << 100 * t->destructive / n << "% of predictions"
+            << endl;
+        ResultRecord r;
+        r.add("predictor", i).add("table", t->name).add("entries_log", t->entriesLog())
+            .add("accesses", t->accesses).add("aliased", t->aliased).add("aliasing_rate", t->aliased / n)
+            .add("entries_used", used).add("entries_shared", shared).add("branches_per_entry", branches)
+            .add("constructive", t->constructive).add("destructive", t->destructive);
+        rows.push_back(r);
+      }
+    }
+  }
+
+  ~AliasingReport() {
+    for (auto &tables: m_tables)
+      for (auto t: tables) delete t;
+  }
+};
+
+static AliasingReport aliasing;
+
+#endif //ARCH_LABS_BRCH_ALIASING_H
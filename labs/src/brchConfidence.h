@@ -0,0 +1,147 @@
+//
+// Confidence of the predictions of every predictor in BP[].
+//
+// Each predictor gets a JRS estimator (Jacobsen, Rotenberg and Smith): a
+// table of resetting counters indexed by the pc xor the global history,
+// counting the correct predictions in a row of that context and cleared by a
+// misprediction. A prediction is tagged by the counter read before it:
+//   high    saturated counter
+//   medium  at least half of the maximum
+//   low     below
+// and the accuracy of every bucket is reported. Low confidence predictions
+// are the candidates for throttling fetch or forking both paths, so the share
+// of all mispredictions they catch matters as much as their accuracy.
+//
+// Fed through observers[] by predictOne, so it works with -parallel. Counts
+// are not weighted by SimPoint.
+//
+#ifndef ARCH_LABS_BRCH_CONFIDENCE_H
+#define ARCH_LABS_BRCH_CONFIDENCE_H
+
+#include "brchPredict.h"
+
+enum ConfidenceLevel {
+  CONFIDENCE_LOW, CONFIDENCE_MEDIUM, CONFIDENCE_HIGH, CONFIDENCE_LEVELS
+};
+
+static const char *const CONFIDENCE_NAMES[CONFIDENCE_LEVELS] = {"low", "medium", "high"};
+
+class JRSEstimator : public PredictionObserver {
+  vector<UINT8> m_counters;
+  const size_t m_entries_log;
+  const size_t m_width;
+  const UINT8 m_max;
+  const size_t m_hist_width;
+  UINT64 m_ghr = 0;
+
+public:
+  UINT64 predictions[CONFIDENCE_LEVELS] = {0};
+  UINT64 correct[CONFIDENCE_LEVELS] = {0};
+
+  // param:   entries_log:  log2 of the counters
+  //          width:        Bits of a counter
+  //          hist_width:   Global history bits hashed with the pc, at most 64
+  JRSEstimator(size_t entries_log = 12, size_t width = 4, size_t hist_width = 8)
+          : m_counters((size_t) 1 << entries_log, 0), m_entries_log(entries_log), m_width(width),
+            m_max((UINT8) ((1u << width) - 1)), m_hist_width(hist_width) {}
+
+  size_t index(ADDRINT pc) const { return truncate((pc >> 2) ^ m_ghr, m_entries_log); }
+
+  ConfidenceLevel level(ADDRINT pc) const {
+    UINT8 c = m_counters[index(pc)];
+    return c == m_max ? CONFIDENCE_HIGH : c >= (m_max + 1) / 2 ? CONFIDENCE_MEDIUM : CONFIDENCE_LOW;
+  }
+
+  // Count the prediction in the bucket of its confidence, then train the counter
+  void observe(ADDRINT pc, bool taken, bool right) override {
+    auto l = level(pc);
+    auto &c = m_counters[index(pc)];
+    predictions[l]++;
+    correct[l] += right ? 1 : 0;
+    if (!right) c = 0;
+    else if (c < m_max) c++;
+    m_ghr = truncate((m_ghr << 1) | (taken ? 1 : 0), m_hist_width);
+  }
+
+  UINT32 capacity() const { return (UINT32) ((m_counters.size() * m_width + m_hist_width) / 8); }
+
+  void config(ResultRecord &r) const {
+    r.add("estimator", "JRS").add("entries_log", m_entries_log).add("counter_width", m_width)
+        .add("ghr_width", m_hist_width);
+  }
+};
+
+class ConfidenceReport {
+  JRSEstimator *m_estimators[TEST_SIZE_MAX] = {nullptr};
+  bool m_enabled = false;
+
+public:
+  bool enabled() const { return m_enabled; }
+
+  // Attach an estimator to every predictor now in BP[]
+  void start(size_t entries_log = 12, size_t width = 4, size_t hist_width = 8) {
+    m_enabled = true;
+    for (int i = 0; i < TEST_SIZE_MAX; i++) {
+      if (!BP[i]) continue;
+      m_estimators[i] = new JRSEstimator(entries_log, width, hist_width);
+      observers[i] = m_estimators[i];
+    }
+  }
+
+  /**
+   * Print the accuracy of every confidence bucket of every predictor, and the
+   * statistics() of those that have some, then add the buckets to rows
+   * @param predictors Indices to report, BP[i] must still exist
+   */
+  void report(ostream &out, vector<ResultRecord> &rows, const vector<int> &predictors) const {
+    if (!m_enabled) return;
+    for (int i: predictors) {
+      auto e = m_estimators[i];
+      if (!e) continue;
+      if (i == predictors.front()) {
+        ResultRecord c;
+        e->config(c);
+        out << "Confidence estimator:";
+        for (auto &f: c.fields()) out << " " << f.first << "=" << f.second;
+        out << ", " << e->capacity() << " bytes" << endl;
+      }
+      UINT64 total = 0, misses = 0;
+      for (int l = 0; l < CONFIDENCE_LEVELS; l++) {
+        total += e->predictions[l];
+        misses += e->predictions[l] - e->correct[l];
+      }
+      out << "confidence[" << i << "]";
+      for (int l = CONFIDENCE_HIGH; l >= CONFIDENCE_LOW; l--) {
+        UINT64 n = e->predictions[l], miss = n - e->correct[l];
+        double share = total ? (double) n / (double) total : 0;
+        double accuracy = n ? (double) e->correct[l] / (double) n : 0;
+        double miss_share = misses ? (double) miss / (double) misses : 0;
+        out << (l == CONFIDENCE_HIGH ? " " : "; ") << CONFIDENCE_NAMES[l] << ": " << 100 * share
+            << "% of predictions, " << 100 * accuracy << "% correct, " << 100 * miss_share << "% of mispredicts";
+        ResultRecord r;
+        r.add("predictor", i).add("confidence", CONFIDENCE_NAMES[l]).add("predictions", n)
+            .add("correct", e->correct[l]).add("prediction_share", share).add("accuracy", accuracy)
+            .add("mispredict_share", miss_share);
+        rows.push_back(r);
+      }
+      out << endl;
+      ResultRecord stats;
+      BP[i]->statistics(stats);
+      if (stats.fields().empty()) continue;
+      out << "statistics[" << i << "]";
+      for (auto &f: stats.fields()) out << " " << f.first << ": " << f.second;
+      out << endl;
+    }
+  }
+
+  ~ConfidenceReport() {
+    for (int i = 0; i < TEST_SIZE_MAX; i++) {
+      if (observers[i] == m_estimators[i]) observers[i] = nullptr;
+      delete m_estimators[i];
+    }
+  }
+};
+
+static ConfidenceReport confidence;
+
+#endif //ARCH_LABS_BRCH_CONFIDENCE_H
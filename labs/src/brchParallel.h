@@ -0,0 +1,147 @@
+//
+// Parallel evaluation of the predictors in BP[].
+//
+// The instrumented thread publishes every branch once to a ring buffer, and
+// each predictor consumes the ring on its own worker thread, so the wall time
+// is that of the slowest predictor instead of the sum of all. The producer
+// stalls when the slowest worker is a whole ring behind.
+//
+// Single producer: like predictBranch, publish() expects one application
+// thread. Threads are created by the caller through a SPAWN function, as the
+// pintool has to use Pin internal threads.
+//
+#ifndef ARCH_LABS_BRCH_PARALLEL_H
+#define ARCH_LABS_BRCH_PARALLEL_H
+
+#include <atomic>
+#include "brchPredict.h"
+
+#ifdef PIN_CRT
+#define RING_YIELD() PIN_Yield()
+#else
+#include <thread>
+#define RING_YIELD() std::this_thread::yield()
+#endif
+
+class ParallelEvaluator {
+public:
+  typedef void (*SPAWN)(void (*func)(void *), void *arg);
+
+private:
+  struct BranchEvent {
+    ADDRINT pc;
+    ADDRINT target;
+    bool taken;
+  };
+
+  // Position of one consumer, on its own cache line
+  struct alignas(64) Cursor {
+    std::atomic<UINT64> pos{0};
+  };
+
+  struct WorkerArg {
+    ParallelEvaluator *self;
+    int slot;
+  };
+
+  static const UINT64 RING_SIZE = 1 << 16;
+  // Workers publish their position every batch, the producer sees it late by at most this
+  static const UINT64 BATCH = 256;
+
+  BranchEvent m_ring[RING_SIZE];
+  alignas(64) std::atomic<UINT64> m_head{0};
+  UINT64 m_next = 0;                // Producer: next position to write
+  UINT64 m_min_tail = 0;            // Producer: cached position of the slowest worker
+  UINT64 m_stalls = 0;              // Producer: times the ring was full
+  Cursor m_tails[TEST_SIZE_MAX];
+  WorkerArg m_args[TEST_SIZE_MAX];
+  int m_slots[TEST_SIZE_MAX];
+  int m_workers = 0;
+  std::atomic<bool> m_closed{false};
+  std::atomic<int> m_running{0};
+  bool m_started = false;
+
+  UINT64 minTail() const {
+    UINT64 m = m_next;
+    for (int k = 0; k < m_workers; k++) {
+      UINT64 t = m_tails[m_slots[k]].pos.load(std::memory_order_acquire);
+      if (t < m) m = t;
+    }
+    return m;
+  }
+
+  void work(int slot) {
+    auto &tail = m_tails[slot].pos;
+    UINT64 pos = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      UINT64 head = m_head.load(std::memory_order_acquire);
+      if (pos == head) {
+        // The final head is published before closing
+        if (m_closed.load(std::memory_order_acquire) && pos == m_head.load(std::memory_order_acquire)) break;
+        RING_YIELD();
+        continue;
+      }
+      while (pos != head) {
+        auto &e = m_ring[pos & (RING_SIZE - 1)];
+        predictOne(slot, e.pc, e.taken, e.target);
+        if (++pos % BATCH == 0) tail.store(pos, std::memory_order_release);
+      }
+      tail.store(pos, std::memory_order_release);
+    }
+    m_running.fetch_sub(1, std::memory_order_release);
+  }
+
+  static void workerMain(void *arg) {
+    auto a = (WorkerArg *) arg;
+    a->self->work(a->slot);
+  }
+
+public:
+  bool started() const { return m_started; }
+
+  UINT64 stalls() const { return m_stalls; }
+
+  int workers() const { return m_workers; }
+
+  // Start one worker per predictor in BP[]
+  void start(SPAWN spawn) {
+    for (int i = 0; i < TEST_SIZE_MAX; i++)
+      if (BP[i]) m_slots[m_workers++] = i;
+    m_running = m_workers;
+    m_started = true;
+    for (int k = 0; k < m_workers; k++) {
+      m_args[k] = {this, m_slots[k]};
+      spawn(workerMain, &m_args[k]);
+    }
+  }
+
+  // Called by the instrumented thread instead of predictBranch
+  void publish(ADDRINT pc, BOOL direction, ADDRINT target) {
+    if (m_next - m_min_tail >= RING_SIZE) {
+      m_min_tail = minTail();
+      while (m_next - m_min_tail >= RING_SIZE) {
+        m_stalls++;
+        RING_YIELD();
+        m_min_tail = minTail();
+      }
+    }
+    m_ring[m_next & (RING_SIZE - 1)] = {pc, target, (bool) direction};
+    m_head.store(++m_next, std::memory_order_release);
+  }
+
+  // Wait until every published branch is consumed, counters in results[] are then up to date
+  void drain() {
+    if (!m_started) return;
+    while (minTail() != m_next) RING_YIELD();
+  }
+
+  // Drain and let the workers exit, safe to call more than once
+  void stop() {
+    if (!m_started) return;
+    m_closed.store(true, std::memory_order_release);
+    while (m_running.load(std::memory_order_acquire) > 0) RING_YIELD();
+    m_started = false;
+  }
+};
+
+#endif //ARCH_LABS_BRCH_PARALLEL_H
@@ -0,0 +1,2108 @@
+//
+// Branch predictors of brchPredict, independent of Pin.
+//
+// Included by the pintool (brchPredict.cpp), which drives predictBranch from
+// the running program, and by brchPredict_replay.cpp, which drives it from a
+// branch trace captured with -trace (see brchTrace.h).
+//
+#ifndef ARCH_LABS_BRCH_PREDICT_H
+#define ARCH_LABS_BRCH_PREDICT_H
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#ifdef PIN_CRT
+#include "pin.H"
+#else
+#include <cstdint>
+typedef uint64_t ADDRINT;
+typedef bool BOOL;
+typedef void VOID;
+typedef int8_t INT8;
+typedef int32_t INT32;
+#define TRUE true
+#define FALSE false
+#endif
+#include "results.h"
+#include "prng.h"
+
+using namespace std;
+
+typedef unsigned char UINT8;
+typedef unsigned short UINT16;
+typedef unsigned int UINT32;
+typedef unsigned long int UINT64;
+typedef unsigned __int128 UINT128;
+
+// 将val截断, 使其宽度变成bits
+#define truncate(val, bits) ((val) & (((UINT64) 1 << (bits)) - 1))
+
+const static int TEST_SIZE_MAX = 32;
+
+// Aligned so that parallel workers do not share cache lines
+class alignas(64) TestResult {
+public:
+  UINT64 takenPcCorrect = 0;
+  UINT64 takenPcIncorrect = 0;
+  UINT64 takenCorrect = 0;
+  UINT64 takenIncorrect = 0;
+  UINT64 notTakenCorrect = 0;
+  UINT64 notTakenIncorrect = 0;
+  const char *name = "Unknown";
+
+  static const int COUNTER_NUM = 6;
+  // SimPoint: counters at the start of the current interval, weighted sums of measured intervals
+  UINT64 intervalBase[COUNTER_NUM] = {0};
+  double weighted[COUNTER_NUM] = {0};
+
+  template<typename F>
+  void forEachCounter(F const &f) {
+    UINT64 *counters[COUNTER_NUM] = {&takenPcCorrect, &takenPcIncorrect, &takenCorrect, &takenIncorrect,
+                                     &notTakenCorrect, &notTakenIncorrect};
+    for (int i = 0; i < COUNTER_NUM; i++) f(i, *counters[i]);
+  }
+
+  void beginInterval() {
+    forEachCounter([this](int i, UINT64 &c) { intervalBase[i] = c; });
+  }
+
+  void endInterval(double weight) {
+    forEachCounter([this, weight](int i, UINT64 &c) { weighted[i] += weight * (double) (c - intervalBase[i]); });
+  }
+
+  // Replace counters with the whole-run estimation
+  void applyWeights(double scale) {
+    forEachCounter([this, scale](int i, UINT64 &c) { c = (UINT64) llround(weighted[i] * scale); });
+  }
+};
+
+static vector<TestResult> results(TEST_SIZE_MAX);
+
+// 饱和计数器 (N < 64)
+class SaturatingCnt {
+  size_t m_wid;
+  UINT8 m_val;
+  const UINT8 m_init_val;
+
+public:
+  // Initial value is weak-taken
+  SaturatingCnt(size_t width = 2) : m_init_val((1 << width) / 2) {
+    m_wid = width;
+    m_val = m_init_val;
+  }
+
+  void increase() { if (m_val < (1 << m_wid) - 1) m_val++; }
+
+  void decrease() { if (m_val > 0) m_val--; }
+
+  void reset() { m_val = m_init_val; }
+
+  UINT8 getVal() { return m_val; }
+
+  bool isTaken() { return (m_val > (1 << m_wid) / 2 - 1); }
+
+  void setVal(UINT8 value) { m_val = value; }
+};
+
+// 全局历史寄存器, 任意长度: bit i 为 i 条分支之前的结果
+// Ring buffer of 64-bit words, shiftIn is O(1) for any width
+class HistoryRegister {
+  vector<UINT64> m_words;
+  size_t m_wid;
+  size_t m_mask;                  // Bits in the ring - 1
+  size_t m_pos = 0;               // Ring position of bit 0, moves down on every shift
+
+public:
+  // Bits [0, width] are readable, the extra bit is the one folded histories shift out
+  explicit HistoryRegister(size_t width) : m_wid(width) {
+    size_t words = 1;
+    // Keep a spare word so that any 64-bit window within the width is two words at most
+    while (words * 64 < width + 1 + 64) words <<= 1;
+    m_words.resize(words, 0);
+    m_mask = words * 64 - 1;
+  }
+
+  void shiftIn(bool b) {
+    m_pos = (m_pos - 1) & m_mask;
+    UINT64 &w = m_words[m_pos >> 6];
+    UINT64 bit = (UINT64) 1 << (m_pos & 63);
+    w = b ? (w | bit) : (w & ~bit);
+  }
+
+  UINT8 operator[](size_t i) const {
+    size_t p = (m_pos + i) & m_mask;
+    return (UINT8) ((m_words[p >> 6] >> (p & 63)) & 1);
+  }
+
+  // n (<= 64) bits starting from bit start, bit start at the LSB
+  UINT64 bits(size_t start, size_t n) const {
+    size_t p = (m_pos + start) & m_mask;
+    size_t off = p & 63;
+    size_t wi = p >> 6;
+    UINT64 v = m_words[wi] >> off;
+    if (off && n > 64 - off) v |= m_words[(wi + 1) & (m_words.size() - 1)] << (64 - off);
+    return n >= 64 ? v : v & (((UINT64) 1 << n) - 1);
+  }
+
+  // The most recent min(width, 128) bits, bit 0 at the LSB
+  UINT128 getVal() const {
+    UINT128 v = bits(0, std::min(m_wid, (size_t) 64));
+    if (m_wid > 64) v |= (UINT128) bits(64, std::min(m_wid, (size_t) 128) - 64) << 64;
+    return v;
+  }
+
+  size_t getMWid() const { return m_wid; }
+};
+
+// History of original_length bits folded (xor) into compressed_length bits, updated incrementally
+class FoldedHistory {
+  UINT32 m_comp = 0;
+  int m_clength = 1;
+  int m_olength = 0;
+  int m_outpoint = 0;
+
+public:
+  void init(int original_length, int compressed_length) {
+    m_comp = 0;
+    m_olength = original_length;
+    m_clength = compressed_length;
+    m_outpoint = original_length % compressed_length;
+  }
+
+  // Call after the new outcome is shifted into h
+  void update(const HistoryRegister &h) {
+    m_comp = (m_comp << 1) | h[0];
+    m_comp ^= (UINT32) h[m_olength] << m_outpoint;
+    m_comp ^= m_comp >> m_clength;
+    m_comp &= (1U << m_clength) - 1;
+  }
+
+  UINT32 getVal() const { return m_comp; }
+};
+
+/**
+ * Path history: bits of the targets of the last taken branches, per_branch
+ * bits each from bit 2 up, kept folded into the index width incrementally so
+ * that reading it costs nothing at predict time. A width of 0 disables it.
+ */
+class PathHistory {
+  HistoryRegister m_path;
+  FoldedHistory m_folded;
+  const size_t m_width;
+  const size_t m_per_branch;
+
+public:
+  // param:   width:        Bits of path history
+  //          index_log:    Width of the folded value, at most 31
+  //          per_branch:   Target bits shifted in by every taken branch
+  PathHistory(size_t width, size_t index_log, size_t per_branch = 2)
+          : m_path(width ? width : 1), m_width(width), m_per_branch(per_branch) {
+    m_folded.init((int) (width ? width : 1), (int) index_log);
+  }
+
+  size_t width() const { return m_width; }
+
+  void update(ADDRINT target) {
+    if (!m_width) return;
+    for (size_t i = 0; i < m_per_branch; i++) {
+      m_path.shiftIn((target >> (2 + i)) & 1);
+      m_folded.update(m_path);
+    }
+  }
+
+  UINT32 getVal() const { return m_folded.getVal(); }
+};
+
+/**
+ * Predictions in flight, oldest first: predict() pushes what it computed,
+ * the delayed table update pops it. A ring grown on demand, so the depth
+ * follows the update delay of the driver.
+ */
+template<typename T>
+class InFlight {
+  vector<T> m_ring;
+  size_t m_head = 0;
+  size_t m_size = 0;
+
+public:
+  InFlight() : m_ring(1) {}
+
+  size_t size() const { return m_size; }
+
+  // Slot of the youngest prediction, entries are reused so their members keep their storage
+  T &push() {
+    if (m_size == m_ring.size()) {
+      vector<T> ring(m_ring.size() * 2);
+      for (size_t i = 0; i < m_size; i++) ring[i] = std::move(m_ring[(m_head + i) % m_ring.size()]);
+      m_ring.swap(ring);
+      m_head = 0;
+    }
+    return m_ring[(m_head + m_size++) % m_ring.size()];
+  }
+
+  T &front() { return m_ring[m_head]; }
+
+  void pop() {
+    m_head = (m_head + 1) % m_ring.size();
+    m_size--;
+  }
+};
+
+/**
+ * Sees every training of one table of counters, before the counter changes,
+ * e.g. to measure aliasing (brchAliasing.h)
+ */
+class TableMonitor {
+public:
+  virtual ~TableMonitor() {}
+
+  // param:   counter:  Value of the entry before training, what it predicted
+  virtual void access(size_t index, ADDRINT pc, bool taken, UINT8 counter) = 0;
+};
+
+class TableMonitorFactory {
+public:
+  virtual ~TableMonitorFactory() {}
+
+  /**
+   * @param name Table within the predictor, e.g. "p1.pht"
+   * @return a monitor of 2^entries_log counters of scnt_width bits, owned by the factory
+   */
+  virtual TableMonitor *create(const string &name, size_t entries_log, size_t scnt_width) = 0;
+};
+
+/**
+ * Base class of all predictors
+ *
+ * Every prediction is followed by exactly one update, in the same order. The
+ * update is split in two phases so that the driver can model a pipeline:
+ * updateHistory at fetch, with the outcome of the branch just predicted, and
+ * updateTables at retire, possibly some branches later. What predict()
+ * computed for the tables travels in an InFlight queue in between.
+ */
+class BranchPredictor {
+public:
+  BranchPredictor() {}
+
+  virtual ~BranchPredictor() {}
+
+  /**
+   * Predict take and pc
+   * @param addr PC to judge
+   * @return 0==not-taken 1==taken other==predicted-pc
+   */
+  virtual ADDRINT predict(ADDRINT addr) { return 0; };
+
+  // Immediate update of both phases
+  virtual void update(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) {
+    updateTables(takenActually, takenPredicted, addr, target);
+    updateHistory(takenActually, addr, target);
+  }
+
+  // Shift the outcome of the branch just predicted into the histories
+  virtual void updateHistory(bool taken, ADDRINT addr, ADDRINT target) {}
+
+  // Train the tables with the outcome of the oldest prediction in flight
+  virtual void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) {}
+
+  virtual uint64_t getTagFromAddr(ADDRINT addr) { return 0; };
+
+  /**
+   * capacity usage **IN BYTES**
+   * @return
+   */
+  virtual UINT32 capacity() { return 0; };
+
+  // Configuration fields for structured results
+  virtual void config(ResultRecord &r) { r.add("kind", "BranchPredictor"); }
+
+  // Counters of the run beyond results[], e.g. of a chooser
+  virtual void statistics(ResultRecord &r) {}
+
+  // Attach a monitor from f to every table of counters indexed once per branch, names prefixed by prefix
+  virtual void monitorTables(TableMonitorFactory &f, const string &prefix = "") {}
+
+  double capacity_kib() { return ((double) capacity()) / 1024.0; };
+};
+
+BranchPredictor *BP[TEST_SIZE_MAX] = {0};
+
+
+/**
+ * StaticPredictor: random choice
+ */
+class StaticPredictor : public BranchPredictor {
+  Xoshiro256 m_rng;
+
+public:
+  void config(ResultRecord &r) override { r.add("kind", "StaticPredictor"); }
+
+private:
+  ADDRINT predict(ADDRINT addr) { return m_rng.coin(); };
+};
+
+/**
+ * Saturating counters of width bits (1..8) packed into 64-bit words,
+ * same behaviour as SaturatingCnt: initial value weak-taken
+ */
+class PackedCounterTable {
+  vector<UINT64> m_words;
+  size_t m_size;
+  UINT32 m_width;
+  UINT32 m_per_word;              // Counters per word, the spare high bits are unused
+  UINT64 m_max;
+  UINT64 m_init;
+
+  UINT32 shift(size_t i) const { return (UINT32) (i % m_per_word) * m_width; }
+
+public:
+  PackedCounterTable(size_t size, size_t width = 2)
+          : m_size(size), m_width((UINT32) width), m_per_word(64 / (UINT32) width),
+            m_max(((UINT64) 1 << width) - 1), m_init(((UINT64) 1 << width) / 2) {
+    UINT64 word = 0;
+    for (UINT32 k = 0; k < m_per_word; k++) word |= m_init << (k * m_width);
+    m_words.resize((size + m_per_word - 1) / m_per_word, word);
+  }
+
+  size_t size() const { return m_size; }
+
+  UINT8 get(size_t i) const { return (UINT8) ((m_words[i / m_per_word] >> shift(i)) & m_max); }
+
+  void set(size_t i, UINT64 v) {
+    auto &w = m_words[i / m_per_word];
+    w = (w & ~(m_max << shift(i))) | ((v & m_max) << shift(i));
+  }
+
+  void increase(size_t i) {
+    auto v = get(i);
+    if (v < m_max) set(i, v + 1);
+  }
+
+  void decrease(size_t i) {
+    auto v = get(i);
+    if (v > 0) set(i, v - 1);
+  }
+
+  void reset(size_t i) { set(i, m_init); }
+
+  bool isTaken(size_t i) const { return get(i) >= m_init; }
+};
+
+/* ===================================================================== */
+/* BHT-based branch predictor                                            */
+/* ===================================================================== */
+class BHTPredictor : public BranchPredictor {
+protected:
+  size_t m_entries_log;
+  PackedCounterTable m_counters;         // BHT
+  vector<ADDRINT> m_targets;             // Only when predicting addresses
+  bool predict_address;
+  size_t m_scnt_width;
+  InFlight<size_t> m_inflight;           // Entries read by predictions in flight
+  TableMonitor *m_monitor = nullptr;
+
+  ADDRINT predictEntry(size_t index) const {
+    if (!m_counters.isTaken(index)) return 0;
+    if (predict_address) {
+      auto target = m_targets[index];
+      return target ? target : 1;
+    }
+    return 1;
+  }
+
+  void updateEntry(size_t index, bool takenActually, ADDRINT target) {
+    if (takenActually) {
+      m_counters.increase(index);
+      if (predict_address) m_targets[index] = target;
+    } else {
+      m_counters.decrease(index);
+    }
+  }
+
+public:
+  // Constructor
+  // param:   entry_num_log:  BHT行数的对数
+  //          scnt_width:     饱和计数器的位数, 默认值为2
+  // max size 33 KiB, every entry (2+64) bit, tot = 66 bit
+  // 33 * 0x400 * 8 = 270336 > 135168 = 66 * 2048 = 66 * 2^n, n = 11
+  explicit BHTPredictor(size_t entry_num_log = 11, size_t scnt_width = 2, bool predict_address = true) :
+          m_entries_log(entry_num_log), m_counters((size_t) 1 << entry_num_log, scnt_width),
+          m_targets(predict_address ? (size_t) 1 << entry_num_log : 0, 0),
+          predict_address(predict_address), m_scnt_width(scnt_width) {}
+
+  UINT32 capacity() override {
+    if (predict_address) {
+      return ((sizeof(ADDRINT) + m_scnt_width) * (1 << m_entries_log)) / 8;
+    } else return (m_scnt_width * (1 << m_entries_log)) / 8;
+  }
+
+  // Destructor
+  ~BHTPredictor() {
+  }
+
+  void config(ResultRecord &r) override {
+    r.add("kind", "BHTPredictor").add("entries_log", m_entries_log).add("scnt_width", m_scnt_width)
+        .add("predict_address", predict_address);
+  }
+
+  uint64_t getTagFromAddr(ADDRINT addr) override {
+    return truncate(addr >> 2, m_entries_log);
+  }
+
+  ADDRINT predict(ADDRINT addr) override {
+    // Produce prediction according to BHT
+    auto index = getTagFromAddr(addr);
+    m_inflight.push() = index;
+    return predictEntry(index);
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    // Update BHT according to branch results and prediction
+    auto index = m_inflight.front();
+    if (m_monitor) m_monitor->access(index, addr, takenActually, m_counters.get(index));
+    updateEntry(index, takenActually, target);
+    m_inflight.pop();
+  }
+
+  void monitorTables(TableMonitorFactory &f, const string &prefix = "") override {
+    m_monitor = f.create(prefix + "pht", m_entries_log, m_scnt_width);
+  }
+};
+
+// CRC-32C byte table of the reflected Castagnoli polynomial, built at compile time
+struct Crc32cTable {
+  UINT32 table[256];
+
+  constexpr Crc32cTable() : table() {
+    for (UINT32 i = 0; i < 256; i++) {
+      UINT32 c = i;
+      for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78U & (0U - (c & 1)));
+      table[i] = c;
+    }
+  }
+};
+
+static constexpr Crc32cTable CRC32C{};
+
+class HashMethods {
+private:
+  /**
+   * Fold data h into m bytes
+   * @tparam F
+   * @param h
+   * @param m
+   * @return
+   */
+  template<typename F>
+  static UINT128 fold(UINT128 h, UINT128 m, F const &f) {
+    UINT128 r = 0;
+    for (int i = 0; i < (128 / 8) / m; i++) {
+      auto s = (((UINT128) 1 << (8 * m)) - 1) & h;
+      h >>= (8 * m);
+      r = f(r, s);
+    }
+    return r;
+  }
+
+  template<typename F>
+  static UINT128 fold_bits(UINT128 h, int m, F const &f) {
+    UINT128 r = 0;
+    for (int i = 0; i < 128; i += m) {
+      auto s = (((UINT128) 1 << m) - 1) & h;
+      r = f(r, s);
+      h >>= m;
+    }
+    return r;
+  }
+
+public:
+  /**
+   * Simply slice address to make hash, assert 4 bytes align
+   * @param addr
+   * @param history
+   * @return hashed data
+   */
+  inline static UINT128 slice(UINT128 addr, UINT128 history) {
+    return addr;
+  }
+
+  // History alone, as in GAg and the global predictor of the Alpha 21264
+  inline static UINT128 global(UINT128 addr, UINT128 history) {
+    return history;
+  }
+
+  inline static UINT128 hash_xor(UINT128 addr, UINT128 history) {
+    return addr ^ history;
+  }
+
+  // Same as fold_bits with xor, but zero slices are skipped and addresses of 64 bits folded in 64-bit words
+  template<int bits = 16>
+  inline static UINT128 fold_xor(UINT128 addr, UINT128 history) {
+    static_assert(bits > 0 && bits <= 128, "fold width");
+    if constexpr (bits >= 64) {
+      return fold_bits(addr, bits, [](auto a, auto b) { return a ^ b; }) ^ history;
+    } else {
+      if (addr >> 64) return fold_bits(addr, bits, [](auto a, auto b) { return a ^ b; }) ^ history;
+      UINT64 a = (UINT64) addr, r = 0;
+      for (; a; a >>= bits) r ^= a & (((UINT64) 1 << bits) - 1);
+      return r ^ history;
+    }
+  }
+
+  /*
+   * Hashes below mix every input bit into the low bits, so that any index
+   * width can be truncated from them. History over 64 bits is folded first.
+   */
+
+  // CRC-32C of the word pc ^ history; linear, one table lookup per byte
+  inline static UINT128 crc(UINT128 addr, UINT128 history) {
+    UINT64 x = (UINT64) (addr >> 2) ^ (UINT64) history ^ (UINT64) (history >> 64);
+    UINT32 c = ~0U;
+    for (int i = 0; i < 8; i++, x >>= 8) c = CRC32C.table[(c ^ (UINT32) x) & 0xff] ^ (c >> 8);
+    return ~c;
+  }
+
+  // Multiplicative hash of the pc, xor the history, through the splitmix64 finalizer
+  inline static UINT128 mix(UINT128 addr, UINT128 history) {
+    UINT64 x = ((UINT64) (addr >> 2) * 0x9e3779b97f4a7c15ULL) ^ (UINT64) history ^ (UINT64) (history >> 64);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+  /*
+   * Skewing functions of n-bit words (Seznec, skewed-associative caches):
+   * H is a shift with feedback, a bijection, so banks indexed through
+   * different combinations of H and its inverse conflict on different pairs.
+   */
+  static UINT64 skewH(UINT64 x, size_t n) {
+    return ((x >> 1) | (((x ^ (x >> (n - 1))) & 1) << (n - 1))) & (((UINT64) 1 << n) - 1);
+  }
+
+  static UINT64 skewHinv(UINT64 x, size_t n) {
+    return ((x << 1) & (((UINT64) 1 << n) - 1)) | (((x >> (n - 1)) ^ (x >> (n - 2))) & 1);
+  }
+
+  /**
+   * Index of bank 0..2 of a skewed table of 2^n entries, n >= 2
+   * @param v1 n bits of the pc
+   * @param v2 n bits of the history
+   */
+  static UINT64 skew(int bank, UINT64 v1, UINT64 v2, size_t n) {
+    switch (bank) {
+      case 0:
+        return skewH(v1, n) ^ skewHinv(v2, n) ^ v2;
+      case 1:
+        return skewH(v1, n) ^ skewHinv(v2, n) ^ v1;
+      default:
+        return skewHinv(v1, n) ^ skewH(v2, n) ^ v2;
+    }
+  }
+
+  // Hash functions
+  inline static UINT128 f_xor(UINT128 a, UINT128 b) { return a ^ b; }
+
+  inline static UINT128 f_xor1(UINT128 a, UINT128 b) { return ~a ^ ~b; }
+
+  inline static UINT128 f_xnor(UINT128 a, UINT128 b) { return ~(a ^ ~b); }
+};
+
+/* ===================================================================== */
+/* Global-history-based branch predictor                                 */
+/* ===================================================================== */
+template<UINT128 (*hash)(UINT128 addr, UINT128 history)>
+class GlobalHistoryPredictor : public BHTPredictor {
+  HistoryRegister m_ghr;             // GHR
+  FoldedHistory m_ghr_folded;        // GHR folded into the index width, for GHRs over 128 bits or fold_history
+  const bool m_fold;
+  PathHistory m_path;
+
+  // History input of the hash: the GHR itself, or its folded view, xor the folded path
+  UINT128 history() const {
+    UINT128 h = m_fold ? (UINT128) m_ghr_folded.getVal() : m_ghr.getVal();
+    return m_path.width() ? h ^ m_path.getVal() : h;
+  }
+
+public:
+  // Constructor
+  // param:   ghr_width:      Width of GHR, any length
+  //          entry_num_log:  PHT表行数的对数
+  //          scnt_width:     饱和计数器的位数, 默认值为2
+  //          path_width:     Bits of path history hashed in, 0 for none
+  //          fold_history:   Hash the GHR folded into entry_num_log bits, always done over 128 bits
+  // PHT.w = 2+64+1, tot = (2^11)*(67.0/8)+8 = 17152B < 33KiB = 270336
+  GlobalHistoryPredictor(size_t ghr_width = 8, size_t entry_num_log = 11, size_t scnt_width = 2,
+                         bool predict_address = true, size_t path_width = 0, bool fold_history = false)
+          : BHTPredictor(entry_num_log, scnt_width, predict_address), m_ghr(ghr_width),
+            m_fold(fold_history || ghr_width > 128), m_path(path_width, entry_num_log) {
+    m_ghr_folded.init((int) ghr_width, (int) entry_num_log);
+  }
+
+  UINT32 capacity() override {
+    // The GHR was never counted, keep the sizes of existing configurations
+    return BHTPredictor::capacity() + (UINT32) ((m_path.width() + 7) / 8);
+  }
+
+  uint64_t getTagFromAddr(ADDRINT addr) override {
+    return truncate(hash(addr, history()), m_entries_log);
+  }
+
+  // Destructor
+  ~GlobalHistoryPredictor() {}
+
+  void config(ResultRecord &r) override {
+    r.add("kind", "GlobalHistoryPredictor").add("ghr_width", m_ghr.getMWid()).add("entries_log", m_entries_log)
+        .add("scnt_width", m_scnt_width).add("predict_address", predict_address);
+    if (m_path.width()) r.add("path_width", m_path.width());
+    if (m_fold) r.add("fold_history", true);
+  }
+
+  // PHT is indexed and trained as in BHTPredictor, through getTagFromAddr
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    m_ghr.shiftIn(taken);
+    if (m_fold) m_ghr_folded.update(m_ghr);
+    if (taken) m_path.update(target);
+  }
+};
+
+/* ===================================================================== */
+/* gskew: majority of three skewed banks                                 */
+/* ===================================================================== */
+
+/**
+ * Three banks of counters indexed by skewed hashes of the pc and the global
+ * history (Michaud, Seznec and Uhlig): two contexts that share an entry of one
+ * bank are unlikely to share one in the others, so the majority outvotes the
+ * aliased bank. Partial update: on a correct prediction only the banks that
+ * agreed with it are trained.
+ */
+class SkewedPredictor : public BranchPredictor {
+  const size_t m_entries_log;
+  const size_t m_scnt_width;
+  PackedCounterTable m_banks[3];
+  HistoryRegister m_ghr;
+  FoldedHistory m_ghr_folded;        // GHR folded into the bank index width
+  struct Indices {
+    size_t bank[3];
+  };
+  InFlight<Indices> m_inflight;
+
+public:
+  // param:   ghr_width:      Width of GHR, any length
+  //          entry_num_log:  log2 of the counters of a bank, at least 2
+  //          scnt_width:     Bits of a counter
+  SkewedPredictor(size_t ghr_width = 12, size_t entry_num_log = 12, size_t scnt_width = 2)
+          : m_entries_log(entry_num_log), m_scnt_width(scnt_width),
+            m_banks{PackedCounterTable((size_t) 1 << entry_num_log, scnt_width),
+                    PackedCounterTable((size_t) 1 << entry_num_log, scnt_width),
+                    PackedCounterTable((size_t) 1 << entry_num_log, scnt_width)},
+            m_ghr(ghr_width) {
+    m_ghr_folded.init((int) ghr_width, (int) entry_num_log);
+  }
+
+  ADDRINT predict(ADDRINT addr) override {
+    auto &index = m_inflight.push().bank;
+    UINT64 pc = truncate(addr >> 2, m_entries_log);
+    int votes = 0;
+    for (int b = 0; b < 3; b++) {
+      index[b] = HashMethods::skew(b, pc, m_ghr_folded.getVal(), m_entries_log);
+      votes += m_banks[b].isTaken(index[b]) ? 1 : 0;
+    }
+    return votes >= 2;
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    auto &index = m_inflight.front().bank;
+    for (int b = 0; b < 3; b++) {
+      if (takenActually == takenPredicted && m_banks[b].isTaken(index[b]) != takenActually) continue;
+      if (takenActually) m_banks[b].increase(index[b]);
+      else m_banks[b].decrease(index[b]);
+    }
+    m_inflight.pop();
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    m_ghr.shiftIn(taken);
+    m_ghr_folded.update(m_ghr);
+  }
+
+  UINT32 capacity() override { return (UINT32) ((3 * m_scnt_width << m_entries_log) / 8); }
+
+  void config(ResultRecord &r) override {
+    r.add("kind", "SkewedPredictor").add("ghr_width", m_ghr.getMWid()).add("entries_log", m_entries_log)
+        .add("scnt_width", m_scnt_width);
+  }
+};
+
+/* ===================================================================== */
+/* Two-level local history predictor: PAg / PAp                          */
+/* ===================================================================== */
+
+/**
+ * A local history table (LHT) of the last outcomes of every branch, indexed
+ * by the pc, selects the counter of the pattern table: PAg with one table
+ * shared by all branches (pc_bits = 0), PAp with the table index extended by
+ * pc_bits of the pc. Learns loops and patterns of a branch whatever the
+ * branches around it do.
+ */
+class LocalHistoryPredictor : public BHTPredictor {
+  const size_t m_lht_log;
+  const size_t m_hist_width;
+  const size_t m_pc_bits;
+  vector<UINT32> m_lht;              // Outcomes of a branch, bit i is i executions ago
+
+  size_t lhtIndex(ADDRINT addr) const { return truncate(addr >> 2, m_lht_log); }
+
+public:
+  // param:   lht_log:      log2 entries of the local history table
+  //          hist_width:   Bits of a local history, at most 24
+  //          pc_bits:      Pc bits in the pattern table index, 0 for PAg
+  //          scnt_width:   Bits of a pattern table counter
+  LocalHistoryPredictor(size_t lht_log = 10, size_t hist_width = 10, size_t pc_bits = 0, size_t scnt_width = 3,
+                        bool predict_address = false)
+          : BHTPredictor(hist_width + pc_bits, scnt_width, predict_address), m_lht_log(lht_log),
+            m_hist_width(hist_width), m_pc_bits(pc_bits), m_lht((size_t) 1 << lht_log, 0) {}
+
+  uint64_t getTagFromAddr(ADDRINT addr) override {
+    return (truncate(addr >> 2, m_pc_bits) << m_hist_width) | m_lht[lhtIndex(addr)];
+  }
+
+  UINT32 capacity() override {
+    return BHTPredictor::capacity() + (UINT32) ((m_lht.size() * m_hist_width) / 8);
+  }
+
+  void config(ResultRecord &r) override {
+    r.add("kind", "LocalHistoryPredictor").add("scheme", m_pc_bits ? "PAp" : "PAg").add("lht_log", m_lht_log)
+        .add("hist_width", m_hist_width).add("pc_bits", m_pc_bits).add("scnt_width", m_scnt_width)
+        .add("predict_address", predict_address);
+  }
+
+  // The pattern table is indexed and trained as in BHTPredictor, through getTagFromAddr
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    auto &h = m_lht[lhtIndex(addr)];
+    h = (UINT32) truncate((h << 1) | (taken ? 1 : 0), m_hist_width);
+  }
+};
+
+/* ===================================================================== */
+/* Tournament predictor: Select output by global/local selection history */
+/* ===================================================================== */
+
+// Where a tournament chooser wins and loses
+struct ChooserStats {
+  UINT64 agree = 0;               // Both sub-predictors right or both wrong, the choice does not matter
+  UINT64 agree_wrong = 0;         // Both wrong
+  UINT64 right = 0;               // Disagreed and the right one was chosen
+  UINT64 wrong = 0;               // Disagreed and the wrong one was chosen
+
+  void count(bool correct0, bool correct1, bool chose1) {
+    if (correct0 == correct1) {
+      agree++;
+      if (!correct0) agree_wrong++;
+    } else if (chose1 ? correct1 : correct0) right++;
+    else wrong++;
+  }
+
+  void record(ResultRecord &r, const string &prefix) const {
+    r.add(prefix + "chooser.agree", agree).add(prefix + "chooser.agree_wrong", agree_wrong)
+        .add(prefix + "chooser.right", right).add(prefix + "chooser.wrong", wrong);
+  }
+};
+
+class TournamentPredictor : public BranchPredictor {
+  BranchPredictor *m_BPs[2];      // Sub-predictors
+  size_t m_chooser_log;
+  PackedCounterTable m_choosers;  // 2-bit counters, BP1 if taken, indexed by the global history
+  UINT64 m_ghr = 0;               // Chooser index, bit i is the outcome i branches ago
+  bool predict_addr;
+
+  struct Meta {
+    ADDRINT predictions[2];
+    size_t chooser;
+    bool choice;                  // BP1 chosen
+  };
+  InFlight<Meta> m_inflight;
+  ChooserStats m_stats;
+
+public:
+  /**
+   * PBs will be managed by this class.
+   * @param BP0
+   * @param BP1
+   * @param chooser_log log2 choosers indexed by as many bits of global history (Alpha 21264), 0 for one
+   * <br/>
+   * width: 66, 67; size: 66*2^10+67*2^11=204800 < 270336
+   */
+  TournamentPredictor(BranchPredictor *BP0, BranchPredictor *BP1, bool predict_addr = true, size_t chooser_log = 0)
+          : m_chooser_log(chooser_log), m_choosers((size_t) 1 << chooser_log, 2) {
+    m_BPs[0] = BP0;
+    m_BPs[1] = BP1;
+    this->predict_addr = predict_addr;
+  }
+
+  // A single chooser is not counted, as ever
+  UINT32 capacity() override {
+    UINT32 choosers = m_chooser_log ? (UINT32) (((2 << m_chooser_log) + m_chooser_log) / 8) : 0;
+    return m_BPs[0]->capacity() + m_BPs[1]->capacity() + choosers;
+  }
+
+  ~TournamentPredictor() {
+    delete m_BPs[0];
+    delete m_BPs[1];
+  }
+
+  void config(ResultRecord &r) override {
+    ResultRecord p0, p1;
+    m_BPs[0]->config(p0);
+    m_BPs[1]->config(p1);
+    r.add("kind", "TournamentPredictor").add("predict_address", predict_addr).add("chooser_log", m_chooser_log)
+        .merge(p0, "p0.").merge(p1, "p1.");
+  }
+
+  void statistics(ResultRecord &r) override {
+    m_stats.record(r, "");
+    ResultRecord p0, p1;
+    m_BPs[0]->statistics(p0);
+    m_BPs[1]->statistics(p1);
+    r.merge(p0, "p0.").merge(p1, "p1.");
+  }
+
+  // The chooser is trained on which sub-predictor was right, not on the direction, and is not monitored
+  void monitorTables(TableMonitorFactory &f, const string &prefix = "") override {
+    m_BPs[0]->monitorTables(f, prefix + "p0.");
+    m_BPs[1]->monitorTables(f, prefix + "p1.");
+  }
+
+  ADDRINT predict(ADDRINT addr) override {
+    // Both sub-predictors are trained, so both predict
+    auto &m = m_inflight.push();
+    m.predictions[0] = m_BPs[0]->predict(addr);
+    m.predictions[1] = m_BPs[1]->predict(addr);
+    m.chooser = truncate(m_ghr, m_chooser_log);
+    m.choice = m_choosers.isTaken(m.chooser);
+    if (m.choice) {
+      return m.predictions[1];
+    } else {
+      return m.predictions[0];
+    }
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    m_BPs[0]->updateHistory(taken, addr, target);
+    m_BPs[1]->updateHistory(taken, addr, target);
+    m_ghr = (m_ghr << 1) | (taken ? 1 : 0);
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    auto predict1 = m_inflight.front().predictions[0];
+    auto predict2 = m_inflight.front().predictions[1];
+    size_t chooser = m_inflight.front().chooser;
+    bool choice = m_inflight.front().choice;
+    m_inflight.pop();
+    bool correct1, correct2;
+    if (!predict_addr) {
+      auto actually = takenActually ? 1 : 0;
+      correct1 = (predict1 ? 1 : 0) == actually;
+      correct2 = (predict2 ? 1 : 0) == actually;
+    } else {
+      // target is that of the branch even when it falls through
+      correct1 = takenActually ? predict1 == target : !predict1;
+      correct2 = takenActually ? predict2 == target : !predict2;
+    }
+    if (correct1 && !correct2) {
+      m_choosers.decrease(chooser);
+    }
+    if (!correct1 && correct2) {
+      m_choosers.increase(chooser);
+    }
+    m_stats.count(correct1, correct2, choice);
+    m_BPs[0]->updateTables(takenActually, takenPredicted, addr, target);
+    m_BPs[1]->updateTables(takenActually, takenPredicted, addr, target);
+  }
+};
+
+/* ===================================================================== */
+/* TArget GEometric history length Predictor                             */
+/* ===================================================================== */
+
+class TAGEPredictor : public BranchPredictor {
+  struct TageEntry {
+    INT8 ctr = 0;                 // Signed counter, taken if >= 0
+    UINT16 tag = 0;
+    UINT8 u = 0;                  // Usefulness
+  };
+
+  const size_t m_tnum;            // Tagged tables T[1 : m_tnum]
+  const size_t m_T0_entries_log;  // Bimodal base predictor T0
+  const size_t m_entries_log;     // Tagged tables
+  const size_t m_tag_width;
+  const size_t m_scnt_width;
+  const size_t m_useful_bits;
+  const size_t m_rst_period;      // Branches between usefulness aging
+  const size_t m_min_hist, m_max_hist;
+
+  vector<INT8> m_base;            // 2-bit counters of T0, taken if >= 0
+  vector<vector<TageEntry>> m_T;  // m_T[1 : m_tnum], longer history with higher index
+  vector<size_t> m_hist_len;
+  HistoryRegister m_ghist;
+  UINT32 m_phist = 0;             // Path history, one address bit per branch
+  vector<FoldedHistory> m_ci, m_ct0, m_ct1;   // Folded for index and the two halves of the tag
+  INT8 m_use_alt_on_na = 0;       // 4-bit, use altpred for newly allocated entries if >= 0
+  size_t m_rst_cnt = 0;
+  UINT32 m_lfsr = 0xACE1u;
+
+  // What a prediction read, for its table update
+  struct Meta {
+    vector<UINT32> gi;
+    vector<UINT16> gt;
+    UINT32 bi = 0;
+    size_t hit = 0, alt = 0;      // Provider and altpred tables, 0 for T0
+    bool provider_pred = false, alt_pred = false, pred = false, new_entry = false;
+  };
+  InFlight<Meta> m_inflight;
+
+  static const int PHIST_WIDTH = 16;
+
+  INT8 ctrMax() const { return (INT8) ((1 << (m_scnt_width - 1)) - 1); }
+
+  INT8 ctrMin() const { return (INT8) -(1 << (m_scnt_width - 1)); }
+
+  UINT8 usefulMax() const { return (UINT8) ((1 << m_useful_bits) - 1); }
+
+  static void ctrUpdate(INT8 &ctr, bool taken, INT8 lo, INT8 hi) {
+    if (taken) {
+      if (ctr < hi) ctr++;
+    } else {
+      if (ctr > lo) ctr--;
+    }
+  }
+
+  UINT32 random() {
+    m_lfsr = (m_lfsr >> 1) ^ (-(m_lfsr & 1u) & 0xB400u);
+    return m_lfsr;
+  }
+
+  // Mix the path history into log bits, rotated differently for every table
+  UINT32 pathHash(UINT32 a, size_t size, size_t bank) const {
+    int logg = (int) m_entries_log;
+    int b = (int) (bank % m_entries_log);
+    a &= (1U << size) - 1;
+    UINT32 a1 = a & ((1U << logg) - 1);
+    UINT32 a2 = a >> logg;
+    if (b) a2 = ((a2 << b) & ((1U << logg) - 1)) + (a2 >> (logg - b));
+    a = a1 ^ a2;
+    if (b) a = ((a << b) & ((1U << logg) - 1)) + (a >> (logg - b));
+    return a;
+  }
+
+  UINT32 index(ADDRINT pc, size_t i) const {
+    size_t shift = (m_entries_log > i ? m_entries_log - i : i - m_entries_log) + 1;
+    UINT32 h = (UINT32) (pc ^ (pc >> shift)) ^ m_ci[i].getVal() ^
+               pathHash(m_phist, std::min(m_hist_len[i], (size_t) PHIST_WIDTH), i);
+    return truncate(h, m_entries_log);
+  }
+
+  UINT16 tag(ADDRINT pc, size_t i) const {
+    return (UINT16) truncate((UINT32) pc ^ m_ct0[i].getVal() ^ (m_ct1[i].getVal() << 1), m_tag_width);
+  }
+
+public:
+  // Constructor
+  // param:   tnum:               Number of tagged tables
+  //          T0_entry_num_log:   log2 entries of the bimodal base table T0
+  //          min_hist, max_hist: History lengths of T1 and T[tnum], geometric in between
+  //          Tn_entry_num_log:   log2 entries of every tagged table
+  //          tag_width:          Tag bits of tagged entries (at most 16)
+  //          scnt_width:         Width of saturating counter (3 by default)
+  //          rst_period:         Branches between halving all usefulness counters
+  // size = 2 * (1<<T0_entry_num_log) + tnum * (scnt_width+tag_width+useful_bits) * (1<<Tn_entry_num_log) + histories
+  TAGEPredictor(size_t tnum, size_t T0_entry_num_log, size_t min_hist, size_t max_hist, size_t Tn_entry_num_log,
+                size_t tag_width = 11, size_t scnt_width = 3, size_t rst_period = 256 * 1024, size_t useful_bits = 2)
+          : m_tnum(tnum), m_T0_entries_log(T0_entry_num_log), m_entries_log(Tn_entry_num_log),
+            m_tag_width(tag_width), m_scnt_width(scnt_width), m_useful_bits(useful_bits), m_rst_period(rst_period),
+            m_min_hist(min_hist), m_max_hist(max_hist), m_base(1 << T0_entry_num_log, 0),
+            m_T(tnum + 1), m_hist_len(tnum + 1, 0), m_ghist(max_hist),
+            m_ci(tnum + 1), m_ct0(tnum + 1), m_ct1(tnum + 1) {
+    for (size_t i = 1; i <= m_tnum; i++) {
+      // Geometric series from min_hist to max_hist
+      double ratio = m_tnum > 1 ? (double) (i - 1) / (double) (m_tnum - 1) : 0;
+      m_hist_len[i] = (size_t) (min_hist * pow((double) max_hist / (double) min_hist, ratio) + 0.5);
+      m_T[i].resize(1 << m_entries_log);
+      m_ci[i].init((int) m_hist_len[i], (int) m_entries_log);
+      m_ct0[i].init((int) m_hist_len[i], (int) m_tag_width);
+      m_ct1[i].init((int) m_hist_len[i], (int) m_tag_width - 1);
+    }
+  }
+
+  UINT32 capacity() override {
+    size_t bits = 2 * ((size_t) 1 << m_T0_entries_log) +
+                  m_tnum * (m_scnt_width + m_tag_width + m_useful_bits) * ((size_t) 1 << m_entries_log) +
+                  m_max_hist + PHIST_WIDTH + 4;
+    return (UINT32) (bits / 8);
+  }
+
+  void config(ResultRecord &r) override {
+    r.add("kind", "TAGEPredictor").add("tables", m_tnum).add("T0_entries_log", m_T0_entries_log)
+        .add("Tn_entries_log", m_entries_log).add("min_hist", m_min_hist).add("max_hist", m_max_hist)
+        .add("tag_width", m_tag_width).add("scnt_width", m_scnt_width).add("useful_bits", m_useful_bits)
+        .add("reset_period", m_rst_period);
+  }
+
+  ADDRINT predict(ADDRINT addr) override {
+    auto &m = m_inflight.push();
+    m.gi.resize(m_tnum + 1);
+    m.gt.resize(m_tnum + 1);
+    m.bi = truncate((UINT32) addr, m_T0_entries_log);
+    m.hit = m.alt = 0;
+    // Provider is the longest matching history, altpred the next one
+    for (size_t i = m_tnum; i >= 1; i--) {
+      m.gi[i] = index(addr, i);
+      m.gt[i] = tag(addr, i);
+      if (m_T[i][m.gi[i]].tag != m.gt[i]) continue;
+      if (!m.hit) m.hit = i;
+      else if (!m.alt) m.alt = i;
+    }
+    bool base_pred = m_base[m.bi] >= 0;
+    m.alt_pred = m.alt ? m_T[m.alt][m.gi[m.alt]].ctr >= 0 : base_pred;
+    if (m.hit) {
+      auto &e = m_T[m.hit][m.gi[m.hit]];
+      m.provider_pred = e.ctr >= 0;
+      // A weak entry with no usefulness yet is likely newly allocated
+      m.new_entry = (e.ctr == 0 || e.ctr == -1) && e.u == 0;
+      m.pred = (m.new_entry && m_use_alt_on_na >= 0) ? m.alt_pred : m.provider_pred;
+    } else {
+      m.provider_pred = m.alt_pred = base_pred;
+      m.new_entry = false;
+      m.pred = base_pred;
+    }
+    return m.pred;
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    auto &m = m_inflight.front();
+    bool taken = takenActually;
+    if (m.hit && m.new_entry && m.provider_pred != m.alt_pred) {
+      if (m.alt_pred == taken) {
+        if (m_use_alt_on_na < 7) m_use_alt_on_na++;
+      } else if (m_use_alt_on_na > -8) m_use_alt_on_na--;
+    }
+
+    // Allocate entries on longer histories on a misprediction, unless a new provider was right
+    bool alloc = m.pred != taken && m.hit < m_tnum && !(m.new_entry && m.provider_pred == taken);
+    if (alloc) {
+      size_t start = m.hit + 1;
+      // Randomly skip one table so that a burst of mispredictions does not fill them in order
+      if (start < m_tnum && (random() & 1)) start++;
+      bool allocated = false;
+      for (size_t i = start; i <= m_tnum; i++) {
+        auto &e = m_T[i][m.gi[i]];
+        if (e.u == 0) {
+          e.tag = m.gt[i];
+          e.ctr = taken ? 0 : -1;
+          allocated = true;
+          break;
+        }
+      }
+      if (!allocated)
+        for (size_t i = start; i <= m_tnum; i++) {
+          auto &e = m_T[i][m.gi[i]];
+          if (e.u > 0) e.u--;
+        }
+    }
+
+    // Age usefulness periodically, so that stale entries can be replaced
+    if (++m_rst_cnt == m_rst_period) {
+      m_rst_cnt = 0;
+      for (size_t i = 1; i <= m_tnum; i++)
+        for (auto &e: m_T[i]) e.u >>= 1;
+    }
+
+    if (m.hit) {
+      auto &e = m_T[m.hit][m.gi[m.hit]];
+      ctrUpdate(e.ctr, taken, ctrMin(), ctrMax());
+      // Also train altpred while the provider is not known to be useful
+      if (e.u == 0) {
+        if (m.alt) ctrUpdate(m_T[m.alt][m.gi[m.alt]].ctr, taken, ctrMin(), ctrMax());
+        else ctrUpdate(m_base[m.bi], taken, -2, 1);
+      }
+      if (m.provider_pred != m.alt_pred) {
+        if (m.provider_pred == taken) {
+          if (e.u < usefulMax()) e.u++;
+        } else if (e.u > 0) e.u--;
+      }
+    } else {
+      ctrUpdate(m_base[m.bi], taken, -2, 1);
+    }
+    m_inflight.pop();
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    m_ghist.shiftIn(taken);
+    m_phist = ((m_phist << 1) | (addr & 1)) & ((1U << PHIST_WIDTH) - 1);
+    for (size_t i = 1; i <= m_tnum; i++) {
+      m_ci[i].update(m_ghist);
+      m_ct0[i].update(m_ghist);
+      m_ct1[i].update(m_ghist);
+    }
+  }
+};
+
+
+/* ===================================================================== */
+/* Perceptron predictors                                                 */
+/* ===================================================================== */
+
+/**
+ * Dot product of int8 weights and int8 inputs of length n (a multiple of 32)
+ * AVX2 when built with -mavx2 (cmake -DBRCH_AVX2=ON), scalar otherwise.
+ * Weights must stay within [-127, 127].
+ */
+inline int dotInt8(const INT8 *w, const INT8 *x, size_t n) {
+#ifdef __AVX2__
+  const __m256i ones8 = _mm256_set1_epi8(1);
+  const __m256i ones16 = _mm256_set1_epi16(1);
+  __m256i acc = _mm256_setzero_si256();
+  for (size_t i = 0; i < n; i += 32) {
+    __m256i wv = _mm256_loadu_si256((const __m256i *) (w + i));
+    __m256i xv = _mm256_loadu_si256((const __m256i *) (x + i));
+    // x is +1, -1 or 0, so the product is a sign operation
+    __m256i p = _mm256_sign_epi8(wv, xv);
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, p), ones16));
+  }
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+  s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+  return _mm_cvtsi128_si32(s);
+#else
+  int sum = 0;
+  for (size_t i = 0; i < n; i++) sum += w[i] * x[i];
+  return sum;
+#endif
+}
+
+/**
+ * Perceptron predictor (Jimenez and Lin): one weight vector per pc hash,
+ * output is the dot product with the global history in +1/-1
+ */
+class PerceptronPredictor : public BranchPredictor {
+  const size_t m_entries_log;
+  const size_t m_hist_len;
+  const size_t m_stride;          // Weights per perceptron, bias and history padded to 32
+  const int m_theta;              // Training threshold
+  vector<INT8> m_weights;
+  vector<INT8> m_x;               // Inputs: 1 for the bias, history as +1/-1, then 0 padding
+
+  struct Meta {
+    size_t row = 0;
+    int y = 0;
+    vector<INT8> x;               // Inputs seen by the prediction
+  };
+  InFlight<Meta> m_inflight;
+
+  static const INT8 W_MAX = 127;
+
+public:
+  // param:   entry_num_log:  log2 number of perceptrons
+  //          hist_len:       Global history bits
+  // size = (hist_len + 1) * 8 * (1<<entry_num_log) + hist_len
+  PerceptronPredictor(size_t entry_num_log = 9, size_t hist_len = 63)
+          : m_entries_log(entry_num_log), m_hist_len(hist_len), m_stride((hist_len + 1 + 31) / 32 * 32),
+            m_theta((int) (1.93 * (double) hist_len + 14)), m_weights(m_stride << entry_num_log, 0),
+            m_x(m_stride, 0) {
+    m_x[0] = 1;
+    for (size_t i = 1; i <= m_hist_len; i++) m_x[i] = -1;
+  }
+
+  UINT32 capacity() override {
+    return (UINT32) (((m_hist_len + 1) * 8 * ((size_t) 1 << m_entries_log) + m_hist_len) / 8);
+  }
+
+  void config(ResultRecord &r) override {
+    r.add("kind", "PerceptronPredictor").add("entries_log", m_entries_log).add("hist_len", m_hist_len)
+        .add("theta", m_theta);
+  }
+
+  ADDRINT predict(ADDRINT addr) override {
+    auto &m = m_inflight.push();
+    m.row = truncate((UINT32) (addr ^ (addr >> m_entries_log)), m_entries_log) * m_stride;
+    m.y = dotInt8(&m_weights[m.row], &m_x[0], m_stride);
+    m.x = m_x;
+    return m.y >= 0;
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    auto &m = m_inflight.front();
+    INT8 t = takenActually ? 1 : -1;
+    if ((m.y >= 0) != takenActually || abs(m.y) <= m_theta) {
+      INT8 *w = &m_weights[m.row];
+      for (size_t i = 0; i <= m_hist_len; i++) {
+        int v = w[i] + t * m.x[i];
+        if (v <= W_MAX && v >= -W_MAX) w[i] = (INT8) v;
+      }
+    }
+    m_inflight.pop();
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    if (m_hist_len > 1) memmove(&m_x[2], &m_x[1], m_hist_len - 1);
+    if (m_hist_len) m_x[1] = taken ? 1 : -1;
+  }
+};
+
+/**
+ * Hashed perceptron: every table holds single weights indexed by the pc and a
+ * global history segment of geometric length, the output is their sum
+ */
+class HashedPerceptronPredictor : public BranchPredictor {
+  const size_t m_entries_log;
+  vector<vector<INT8>> m_tables;  // m_tables[0] is indexed by the pc only
+  vector<size_t> m_hist_len;
+  HistoryRegister m_ghist;
+  vector<FoldedHistory> m_folded;
+  int m_theta;
+  int m_tc = 0;                   // Threshold adaptation counter
+
+  struct Meta {
+    vector<UINT32> index;
+    int y = 0;
+  };
+  InFlight<Meta> m_inflight;
+
+  static const INT8 W_MAX = 127;
+  static const int TC_MAX = 63;
+
+public:
+  // param:   tables:             Number of weight tables, including the bias table
+  //          entry_num_log:      log2 weights per table
+  //          min_hist, max_hist: History lengths of tables 1 and tables-1, geometric in between
+  // size = tables * 8 * (1<<entry_num_log) + max_hist
+  HashedPerceptronPredictor(size_t tables = 8, size_t entry_num_log = 12, size_t min_hist = 4, size_t max_hist = 256)
+          : m_entries_log(entry_num_log), m_tables(tables, vector<INT8>(1 << entry_num_log, 0)),
+            m_hist_len(tables, 0), m_ghist(max_hist), m_folded(tables),
+            m_theta((int) tables * 2 + 2) {
+    for (size_t i = 1; i < tables; i++) {
+      double ratio = tables > 2 ? (double) (i - 1) / (double) (tables - 2) : 0;
+      m_hist_len[i] = (size_t) (min_hist * pow((double) max_hist / (double) min_hist, ratio) + 0.5);
+      m_folded[i].init((int) m_hist_len[i], (int) m_entries_log);
+    }
+  }
+
+  UINT32 capacity() override {
+    return (UINT32) ((m_tables.size() * 8 * ((size_t) 1 << m_entries_log) + m_hist_len.back()) / 8);
+  }
+
+  void config(ResultRecord &r) override {
+    r.add("kind", "HashedPerceptronPredictor").add("tables", m_tables.size()).add("entries_log", m_entries_log)
+        .add("min_hist", m_hist_len.size() > 1 ? m_hist_len[1] : 0).add("max_hist", m_hist_len.back());
+  }
+
+  ADDRINT predict(ADDRINT addr) override {
+    auto &m = m_inflight.push();
+    m.index.resize(m_tables.size());
+    m.y = 0;
+    for (size_t i = 0; i < m_tables.size(); i++) {
+      m.index[i] = truncate((UINT32) (addr ^ (addr >> (m_entries_log - i % m_entries_log))) ^
+                            (i ? m_folded[i].getVal() : 0), m_entries_log);
+      m.y += m_tables[i][m.index[i]];
+    }
+    return m.y >= 0;
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    auto &m = m_inflight.front();
+    bool mispredicted = (m.y >= 0) != takenActually;
+    // Adapt the threshold to keep mispredictions and low-confidence updates balanced (O-GEHL)
+    if (mispredicted) {
+      if (++m_tc >= TC_MAX) {
+        m_theta++;
+        m_tc = 0;
+      }
+    } else if (abs(m.y) <= m_theta) {
+      if (--m_tc <= -TC_MAX - 1) {
+        if (m_theta > 1) m_theta--;
+        m_tc = 0;
+      }
+    }
+    if (mispredicted || abs(m.y) <= m_theta) {
+      for (size_t i = 0; i < m_tables.size(); i++) {
+        auto &w = m_tables[i][m.index[i]];
+        if (takenActually) {
+          if (w < W_MAX) w++;
+        } else if (w > -W_MAX) w--;
+      }
+    }
+    m_inflight.pop();
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    m_ghist.shiftIn(taken);
+    for (size_t i = 1; i < m_folded.size(); i++) m_folded[i].update(m_ghist);
+  }
+};
+
+/* ===================================================================== */
+/* Loop predictor: constant trip count loops                             */
+/* ===================================================================== */
+class LoopPredictor {
+  struct LoopEntry {
+    UINT16 tag = 0;
+    UINT16 pastIter = 0;          // Trip count seen last time
+    UINT16 currentIter = 0;
+    UINT8 confidence = 0;         // Times pastIter repeated
+    UINT8 age = 0;                // Replacement priority
+    bool dir = false;             // Direction while iterating, the exit goes the other way
+  };
+
+  const size_t m_entries_log;
+  const size_t m_tag_width;
+  const size_t m_iter_width;
+  vector<LoopEntry> m_table;
+  static const UINT8 CONF_MAX = 3;
+  static const UINT8 AGE_MAX = 255;
+
+  struct Meta {
+    UINT32 index = 0;
+    UINT16 tag = 0;
+    bool hit = false, valid = false, pred = false;
+  };
+  InFlight<Meta> m_inflight;
+
+public:
+  // param:   entry_num_log:  log2 entries of the loop table
+  //          tag_width:      Tag bits
+  //          iter_width:     Bits of the iteration counters, longer loops are not tracked
+  explicit LoopPredictor(size_t entry_num_log = 6, size_t tag_width = 14, size_t iter_width = 10)
+          : m_entries_log(entry_num_log), m_tag_width(tag_width), m_iter_width(iter_width),
+            m_table(1 << entry_num_log) {}
+
+  UINT32 capacity() const {
+    // tag, two iteration counters, 2-bit confidence, 8-bit age, direction
+    return (UINT32) (((m_tag_width + 2 * m_iter_width + 2 + 8 + 1) << m_entries_log) / 8);
+  }
+
+  void config(ResultRecord &r, const string &prefix = "") const {
+    r.add(prefix + "entries_log", m_entries_log).add(prefix + "tag_width", m_tag_width)
+        .add(prefix + "iter_width", m_iter_width);
+  }
+
+  /**
+   * @param valid Set to whether the loop hit has a confident trip count
+   */
+  bool predict(ADDRINT addr, bool &valid) {
+    auto &m = m_inflight.push();
+    m.index = truncate((UINT32) addr, m_entries_log);
+    m.tag = (UINT16) truncate((UINT32) (addr >> m_entries_log), m_tag_width);
+    auto &e = m_table[m.index];
+    m.hit = e.tag == m.tag && e.age;
+    m.valid = m.hit && e.confidence == CONF_MAX;
+    m.pred = m.hit && (e.currentIter + 1 == e.pastIter ? !e.dir : e.dir);
+    valid = m.valid;
+    return m.pred;
+  }
+
+  /**
+   * Train with the outcome of the oldest prediction in flight
+   * @param mainMispredicted Whether the main predictor was wrong, a chance for a new loop
+   */
+  void update(bool taken, bool mainMispredicted) {
+    auto m = m_inflight.front();
+    m_inflight.pop();
+    auto &e = m_table[m.index];
+    if (m.hit) {
+      if (m.valid && m.pred != taken) {
+        // The trip count changed, forget the loop
+        e = LoopEntry();
+        return;
+      }
+      if (m.valid && e.age < AGE_MAX) e.age++;
+      e.currentIter = (UINT16) truncate(e.currentIter + 1, m_iter_width);
+      if (e.currentIter == 0) {
+        // Too long to track
+        e = LoopEntry();
+        return;
+      }
+      if (taken != e.dir) {
+        // Loop exit
+        if (e.currentIter == e.pastIter) {
+          if (e.confidence < CONF_MAX) e.confidence++;
+        } else if (e.pastIter == 0) {
+          e.pastIter = e.currentIter;
+        } else {
+          // Not a constant trip count
+          e.pastIter = e.currentIter;
+          e.confidence = 0;
+        }
+        e.currentIter = 0;
+      }
+    } else if (mainMispredicted) {
+      if (e.age == 0) {
+        // Guess this outcome is the exit of a loop going the other way
+        e = LoopEntry();
+        e.tag = m.tag;
+        e.dir = !taken;
+        e.age = AGE_MAX;
+      } else {
+        e.age--;
+      }
+    }
+  }
+};
+
+/* ===================================================================== */
+/* Statistical corrector: GEHL tables with an adaptive threshold         */
+/* ===================================================================== */
+class StatisticalCorrector {
+  const size_t m_entries_log;
+  const size_t m_ctr_width;
+  vector<INT8> m_bias;            // Indexed by pc and the input prediction
+  vector<vector<INT8>> m_gehl;    // Indexed by pc and global history of geometric lengths
+  vector<size_t> m_hist_len;
+  HistoryRegister m_ghist;
+  vector<FoldedHistory> m_folded;
+  int m_threshold;
+  int m_tc = 0;                   // Threshold adaptation counter
+
+  struct Meta {
+    UINT32 bi = 0;
+    vector<UINT32> gi;
+    int sum = 0;
+    bool input = false;
+  };
+  InFlight<Meta> m_inflight;
+
+  static const int TC_MAX = 63;
+
+  INT8 ctrMax() const { return (INT8) ((1 << (m_ctr_width - 1)) - 1); }
+
+  INT8 ctrMin() const { return (INT8) -(1 << (m_ctr_width - 1)); }
+
+  void ctrUpdate(INT8 &ctr, bool taken) const {
+    if (taken) {
+      if (ctr < ctrMax()) ctr++;
+    } else {
+      if (ctr > ctrMin()) ctr--;
+    }
+  }
+
+public:
+  // param:   tables:         GEHL tables besides the bias table
+  //          entry_num_log:  log2 entries of every table
+  //          min_hist, max_hist: History lengths of the first and last GEHL table
+  //          ctr_width:      Width of the signed counters
+  StatisticalCorrector(size_t tables = 6, size_t entry_num_log = 10, size_t min_hist = 3, size_t max_hist = 40,
+                       size_t ctr_width = 6)
+          : m_entries_log(entry_num_log), m_ctr_width(ctr_width), m_bias(2 << entry_num_log, 0),
+            m_gehl(tables, vector<INT8>(1 << entry_num_log, 0)), m_hist_len(tables, 0), m_ghist(max_hist),
+            m_folded(tables), m_threshold((int) tables * 6) {
+    for (size_t i = 0; i < tables; i++) {
+      double ratio = tables > 1 ? (double) i / (double) (tables - 1) : 0;
+      m_hist_len[i] = (size_t) (min_hist * pow((double) max_hist / (double) min_hist, ratio) + 0.5);
+      m_folded[i].init((int) m_hist_len[i], (int) m_entries_log);
+    }
+  }
+
+  size_t maxHist() const { return m_hist_len.empty() ? 0 : m_hist_len.back(); }
+
+  UINT32 capacity() const {
+    // Counters, the global history and the threshold with its counter
+    size_t bits = (m_bias.size() + m_gehl.size() * ((size_t) 1 << m_entries_log)) * m_ctr_width + maxHist() + 16;
+    return (UINT32) (bits / 8);
+  }
+
+  void config(ResultRecord &r, const string &prefix = "") const {
+    r.add(prefix + "tables", m_gehl.size()).add(prefix + "entries_log", m_entries_log)
+        .add(prefix + "min_hist", m_hist_len.empty() ? 0 : m_hist_len.front()).add(prefix + "max_hist", maxHist())
+        .add(prefix + "ctr_width", m_ctr_width);
+  }
+
+  /**
+   * Correct the input prediction when the tables disagree with it confidently
+   * @param input Prediction of the main predictor
+   */
+  bool predict(ADDRINT addr, bool input) {
+    auto &m = m_inflight.push();
+    m.gi.resize(m_gehl.size());
+    m.input = input;
+    m.bi = truncate((UINT32) ((addr << 1) | input), m_entries_log + 1);
+    m.sum = 2 * m_bias[m.bi] + 1;
+    for (size_t i = 0; i < m_gehl.size(); i++) {
+      m.gi[i] = truncate((UINT32) (addr ^ (addr >> (i + 1))) ^ m_folded[i].getVal(), m_entries_log);
+      m.sum += 2 * m_gehl[i][m.gi[i]] + 1;
+    }
+    return abs(m.sum) >= m_threshold ? m.sum >= 0 : input;
+  }
+
+  // Train with the outcome of the oldest prediction in flight
+  void update(bool taken) {
+    auto &m = m_inflight.front();
+    bool sc_pred = m.sum >= 0;
+    // Too many overrides going wrong raise the threshold, too many right ones lower it
+    if (sc_pred != m.input && abs(m.sum) >= m_threshold - 4) {
+      if (sc_pred != taken) {
+        if (++m_tc >= TC_MAX) {
+          m_threshold++;
+          m_tc = 0;
+        }
+      } else if (--m_tc <= -TC_MAX - 1) {
+        if (m_threshold > 1) m_threshold--;
+        m_tc = 0;
+      }
+    }
+    if (sc_pred != taken || abs(m.sum) < m_threshold) {
+      ctrUpdate(m_bias[m.bi], taken);
+      for (size_t i = 0; i < m_gehl.size(); i++) ctrUpdate(m_gehl[i][m.gi[i]], taken);
+    }
+    m_inflight.pop();
+  }
+
+  void updateHistory(bool taken) {
+    m_ghist.shiftIn(taken);
+    for (auto &f: m_folded) f.update(m_ghist);
+  }
+};
+
+/* ===================================================================== */
+/* TAGE-SC-L: main predictor, loop predictor and statistical corrector   */
+/* ===================================================================== */
+class TAGESCLPredictor : public BranchPredictor {
+  BranchPredictor *m_main;        // Usually TAGE, managed by this class
+  LoopPredictor m_loop;
+  StatisticalCorrector m_sc;
+  INT8 m_use_loop = -1;           // 7-bit, trust a confident loop prediction if >= 0
+
+  struct Meta {
+    bool main_pred = false, loop_pred = false, loop_valid = false;
+  };
+  InFlight<Meta> m_inflight;
+
+public:
+  /**
+   * @param main Main predictor, only its direction is used
+   * @param loop Loop predictor
+   * @param sc Statistical corrector
+   */
+  explicit TAGESCLPredictor(BranchPredictor *main, LoopPredictor loop = LoopPredictor(),
+                            StatisticalCorrector sc = StatisticalCorrector())
+          : m_main(main), m_loop(std::move(loop)), m_sc(std::move(sc)) {}
+
+  ~TAGESCLPredictor() {
+    delete m_main;
+  }
+
+  UINT32 capacity() override {
+    return m_main->capacity() + m_loop.capacity() + m_sc.capacity();
+  }
+
+  void config(ResultRecord &r) override {
+    ResultRecord main;
+    m_main->config(main);
+    r.add("kind", "TAGESCLPredictor").merge(main, "main.");
+    m_loop.config(r, "loop.");
+    m_sc.config(r, "sc.");
+  }
+
+  ADDRINT predict(ADDRINT addr) override {
+    auto &m = m_inflight.push();
+    m.main_pred = m_main->predict(addr) != 0;
+    m.loop_pred = m_loop.predict(addr, m.loop_valid);
+    bool pred = (m.loop_valid && m_use_loop >= 0) ? m.loop_pred : m.main_pred;
+    return m_sc.predict(addr, pred);
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    auto m = m_inflight.front();
+    m_inflight.pop();
+    if (m.loop_valid && m.loop_pred != m.main_pred) {
+      if (m.loop_pred == takenActually) {
+        if (m_use_loop < 63) m_use_loop++;
+      } else if (m_use_loop > -64) m_use_loop--;
+    }
+    m_loop.update(takenActually, m.main_pred != takenActually);
+    m_sc.update(takenActually);
+    m_main->updateTables(takenActually, m.main_pred, addr, target);
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override {
+    m_sc.updateHistory(taken);
+    m_main->updateHistory(taken, addr, target);
+  }
+};
+
+/* ===================================================================== */
+/* Statically composed predictors                                        */
+/* ===================================================================== */
+/*
+ * Components with the interface of BranchPredictor but no virtual methods,
+ * composed by template parameters, e.g. Tournament<Bimodal<16>, GShare<20, 16>>.
+ * Only Composed<P> is virtual, so a composite costs one virtual call per
+ * branch and everything below it inlines. Direction only: targets are
+ * predicted by targetPredict.h.
+ */
+
+// 2-bit (SCNT_WIDTH) counters indexed by the pc
+template<size_t ENTRIES_LOG, size_t SCNT_WIDTH = 2>
+class Bimodal {
+  PackedCounterTable m_counters;
+  TableMonitor *m_monitor = nullptr;
+
+  static size_t index(ADDRINT addr) { return truncate(addr >> 2, ENTRIES_LOG); }
+
+public:
+  Bimodal() : m_counters((size_t) 1 << ENTRIES_LOG, SCNT_WIDTH) {}
+
+  ADDRINT predict(ADDRINT addr) { return m_counters.isTaken(index(addr)); }
+
+  // The index depends on the pc only, so nothing is kept in flight
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) {
+    if (m_monitor) m_monitor->access(index(addr), addr, takenActually, m_counters.get(index(addr)));
+    if (takenActually) m_counters.increase(index(addr));
+    else m_counters.decrease(index(addr));
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) {}
+
+  UINT32 capacity() const { return (UINT32) ((SCNT_WIDTH << ENTRIES_LOG) / 8); }
+
+  void config(ResultRecord &r, const string &prefix = "") const {
+    r.add(prefix + "kind", "Bimodal").add(prefix + "entries_log", ENTRIES_LOG).add(prefix + "scnt_width", SCNT_WIDTH);
+  }
+
+  void statistics(ResultRecord &r, const string &prefix = "") const {}
+
+  void monitorTables(TableMonitorFactory &f, const string &prefix = "") {
+    m_monitor = f.create(prefix + "pht", ENTRIES_LOG, SCNT_WIDTH);
+  }
+};
+
+// Counters indexed by the pc hashed with a global history of up to 64 bits
+template<size_t HIST_WIDTH, size_t ENTRIES_LOG, size_t SCNT_WIDTH = 2,
+        UINT128 (*HASH)(UINT128, UINT128) = HashMethods::fold_xor<HIST_WIDTH>>
+class GShare {
+  static_assert(HIST_WIDTH > 0 && HIST_WIDTH <= 64, "GShare history fits in one word");
+
+  PackedCounterTable m_counters;
+  UINT64 m_ghr = 0;               // Bit i is the outcome i branches ago
+  InFlight<size_t> m_inflight;
+  TableMonitor *m_monitor = nullptr;
+
+public:
+  GShare() : m_counters((size_t) 1 << ENTRIES_LOG, SCNT_WIDTH) {}
+
+  ADDRINT predict(ADDRINT addr) {
+    size_t index = truncate(HASH(addr, m_ghr), ENTRIES_LOG);
+    m_inflight.push() = index;
+    return m_counters.isTaken(index);
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) {
+    if (m_monitor) m_monitor->access(m_inflight.front(), addr, takenActually, m_counters.get(m_inflight.front()));
+    if (takenActually) m_counters.increase(m_inflight.front());
+    else m_counters.decrease(m_inflight.front());
+    m_inflight.pop();
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) {
+    m_ghr = truncate((m_ghr << 1) | taken, HIST_WIDTH);
+  }
+
+  UINT32 capacity() const { return (UINT32) (((SCNT_WIDTH << ENTRIES_LOG) + HIST_WIDTH) / 8); }
+
+  void config(ResultRecord &r, const string &prefix = "") const {
+    r.add(prefix + "kind", "GShare").add(prefix + "ghr_width", HIST_WIDTH).add(prefix + "entries_log", ENTRIES_LOG)
+        .add(prefix + "scnt_width", SCNT_WIDTH);
+  }
+
+  void statistics(ResultRecord &r, const string &prefix = "") const {}
+
+  void monitorTables(TableMonitorFactory &f, const string &prefix = "") {
+    m_monitor = f.create(prefix + "pht", ENTRIES_LOG, SCNT_WIDTH);
+  }
+};
+
+// Chooses between P0 and P1 with a 2-bit counter trained on which one was right
+template<typename P0, typename P1>
+class Tournament {
+  P0 m_p0;
+  P1 m_p1;
+  SaturatingCnt m_choice;         // P1 if taken
+
+  struct Meta {
+    bool p0, p1, choice;
+  };
+  InFlight<Meta> m_inflight;
+  ChooserStats m_stats;
+
+public:
+  Tournament() : m_choice(2) {}
+
+  ADDRINT predict(ADDRINT addr) {
+    auto &m = m_inflight.push();
+    m.p0 = m_p0.predict(addr) != 0;
+    m.p1 = m_p1.predict(addr) != 0;
+    m.choice = m_choice.isTaken();
+    return m.choice ? m.p1 : m.p0;
+  }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) {
+    auto m = m_inflight.front();
+    m_inflight.pop();
+    bool correct0 = m.p0 == takenActually, correct1 = m.p1 == takenActually;
+    if (correct0 && !correct1) m_choice.decrease();
+    if (!correct0 && correct1) m_choice.increase();
+    m_stats.count(correct0, correct1, m.choice);
+    m_p0.updateTables(takenActually, m.p0, addr, target);
+    m_p1.updateTables(takenActually, m.p1, addr, target);
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) {
+    m_p0.updateHistory(taken, addr, target);
+    m_p1.updateHistory(taken, addr, target);
+  }
+
+  UINT32 capacity() const { return m_p0.capacity() + m_p1.capacity(); }
+
+  void config(ResultRecord &r, const string &prefix = "") const {
+    r.add(prefix + "kind", "Tournament");
+    m_p0.config(r, prefix + "p0.");
+    m_p1.config(r, prefix + "p1.");
+  }
+
+  void statistics(ResultRecord &r, const string &prefix = "") const {
+    m_stats.record(r, prefix);
+    m_p0.statistics(r, prefix + "p0.");
+    m_p1.statistics(r, prefix + "p1.");
+  }
+
+  void monitorTables(TableMonitorFactory &f, const string &prefix = "") {
+    m_p0.monitorTables(f, prefix + "p0.");
+    m_p1.monitorTables(f, prefix + "p1.");
+  }
+};
+
+// The only virtual layer of a static composition
+template<typename P>
+class Composed final : public BranchPredictor {
+  P m_p;
+
+public:
+  ADDRINT predict(ADDRINT addr) override { return m_p.predict(addr); }
+
+  void update(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    m_p.updateTables(takenActually, takenPredicted, addr, target);
+    m_p.updateHistory(takenActually, addr, target);
+  }
+
+  void updateHistory(bool taken, ADDRINT addr, ADDRINT target) override { m_p.updateHistory(taken, addr, target); }
+
+  void updateTables(bool takenActually, bool takenPredicted, ADDRINT addr, ADDRINT target) override {
+    m_p.updateTables(takenActually, takenPredicted, addr, target);
+  }
+
+  UINT32 capacity() override { return m_p.capacity(); }
+
+  void config(ResultRecord &r) override { m_p.config(r); }
+
+  void statistics(ResultRecord &r) override { m_p.statistics(r); }
+
+  void monitorTables(TableMonitorFactory &f, const string &prefix = "") override { m_p.monitorTables(f, prefix); }
+};
+
+// Static compositions selectable by name at run time
+struct StaticPredictorEntry {
+  const char *name;
+  BranchPredictor *(*create)();
+};
+
+template<typename P>
+BranchPredictor *createComposed() { return new Composed<P>(); }
+
+static const StaticPredictorEntry STATIC_PREDICTORS[] = {
+        {"bimodal-13", createComposed<Bimodal<13>>},
+        {"bimodal-16", createComposed<Bimodal<16>>},
+        {"bimodal-17", createComposed<Bimodal<17>>},
+        {"gshare-12-13", createComposed<GShare<12, 13>>},
+        {"gshare-16-16", createComposed<GShare<16, 16>>},
+        {"gshare-20-16", createComposed<GShare<20, 16>>},
+        {"gshare-20-17", createComposed<GShare<20, 17>>},
+        {"tournament-bimodal13-gshare20-13", createComposed<Tournament<Bimodal<13>, GShare<20, 13>>>},
+        {"tournament-bimodal16-gshare20-16", createComposed<Tournament<Bimodal<16>, GShare<20, 16>>>},
+        {"tournament-gshare12-13-gshare20-16", createComposed<Tournament<GShare<12, 13>, GShare<20, 16>>>},
+};
+
+// @return the static composition called name, nullptr if unknown
+const StaticPredictorEntry *FindStaticPredictor(const string &name) {
+  for (auto &e: STATIC_PREDICTORS)
+    if (name == e.name) return &e;
+  return nullptr;
+}
+
+void ListStaticPredictors(ostream &out) {
+  for (auto &e: STATIC_PREDICTORS) out << "  " << e.name << endl;
+}
+
+/*
+ * Delayed update: tables are trained when a branch retires, update_delay
+ * branches after it was predicted, while the history is updated at fetch.
+ * The history is speculative in hardware and repaired on a misprediction;
+ * a trace holds only the correct path, where the repaired history is that of
+ * the actual outcomes, so each prediction sees the outcomes of all older
+ * branches. 0 updates immediately, as predictors were evaluated so far.
+ */
+static size_t update_delay = 0;
+
+struct PendingBranch {
+  ADDRINT pc;
+  ADDRINT target;
+  ADDRINT prediction;
+  bool taken;
+};
+
+// Branches predicted but not retired, per predictor as parallel workers run apart
+static vector<InFlight<PendingBranch>> pending(TEST_SIZE_MAX);
+
+inline void delayedUpdate(int i, ADDRINT pc, BOOL direction, ADDRINT target, ADDRINT prediction) {
+  auto P = BP[i];
+  auto &q = pending[i];
+  P->updateHistory(direction, pc, target);
+  q.push() = {pc, target, prediction, (bool) direction};
+  if (q.size() > update_delay) {
+    auto &b = q.front();
+    P->updateTables(b.taken, b.prediction != 0, b.pc, b.target);
+    q.pop();
+  }
+}
+
+// Sees the outcome of every prediction of one predictor, e.g. a confidence estimator (brchConfidence.h)
+class PredictionObserver {
+public:
+  virtual ~PredictionObserver() {}
+
+  virtual void observe(ADDRINT pc, bool taken, bool correct) = 0;
+};
+
+static PredictionObserver *observers[TEST_SIZE_MAX] = {nullptr};
+
+// Predict and update predictor i, then count the outcome
+// @return whether the direction was predicted right
+inline bool predictOne(int i, ADDRINT pc, BOOL direction, ADDRINT target) {
+  auto P = BP[i];
+  auto &r = results[i];
+  ADDRINT prediction = P->predict(pc);
+  if (update_delay) delayedUpdate(i, pc, direction, target, prediction);
+  else P->update(direction, prediction, pc, target);
+  if (prediction) {
+    if (direction) {
+      r.takenCorrect++;
+      // == 1 means no prediction
+      if (prediction != 1) {
+        if (prediction == target) {
+          r.takenPcCorrect++;
+        } else {
+          r.takenPcIncorrect++;
+          // OutFile << "Incorrect predict:real = " << hex << (int) prediction << ":" << (int) target << endl;
+        }
+      }
+    } else
+      r.takenIncorrect++;
+  } else {
+    if (direction)
+      r.notTakenIncorrect++;
+    else
+      r.notTakenCorrect++;
+  }
+  bool correct = (prediction != 0) == (bool) direction;
+  if (observers[i]) observers[i]->observe(pc, direction, correct);
+  return correct;
+}
+
+// This function is called every time a control-flow instruction is encountered
+void predictBranch(ADDRINT pc, BOOL direction, ADDRINT target) {
+  for (int i = 0; i < TEST_SIZE_MAX; i++) {
+    if (BP[i]) predictOne(i, pc, direction, target);
+  }
+}
+
+// Full result row: configuration, counters and capacity
+ResultRecord recordResult(int i) {
+  auto &r = results[i];
+  ResultRecord rec;
+  rec.add("index", i).add("predictor", r.name);
+  BP[i]->config(rec);
+  UINT64 total = r.takenCorrect + r.takenIncorrect + r.notTakenCorrect + r.notTakenIncorrect;
+  UINT64 pcTotal = r.takenPcCorrect + r.takenPcIncorrect;
+  rec.add("capacity_bytes", BP[i]->capacity()).add("capacity_kib", BP[i]->capacity_kib())
+      .add("taken_correct", r.takenCorrect).add("taken_incorrect", r.takenIncorrect)
+      .add("not_taken_correct", r.notTakenCorrect).add("not_taken_incorrect", r.notTakenIncorrect)
+      .add("taken_pc_correct", r.takenPcCorrect).add("taken_pc_incorrect", r.takenPcIncorrect)
+      .add("branches", total)
+      .add("precision", total ? (double) (r.takenCorrect + r.notTakenCorrect) / (double) total : 0.0)
+      .add("pc_precision", pcTotal ? (double) r.takenPcCorrect / (double) pcTotal : 0.0);
+  BP[i]->statistics(rec);
+  return rec;
+}
+
+// Index of the predictor with the best direction precision, -1 if none ran
+int BestPredictor() {
+  int best = -1;
+  double precision_best = 0;
+  for (int i = 0; i < TEST_SIZE_MAX; i++) {
+    if (!BP[i]) continue;
+    auto &r = results[i];
+    UINT64 total = r.takenCorrect + r.notTakenCorrect + r.takenIncorrect + r.notTakenIncorrect;
+    double precision = total ? (double) (r.takenCorrect + r.notTakenCorrect) / (double) total : 0;
+    if (precision > precision_best) {
+      precision_best = precision;
+      best = i;
+    }
+  }
+  return best;
+}
+
+/**
+ * Print the counters of every predictor and the best one, then delete the predictors
+ * @param out Result file
+ */
+void ReportResults(ostream &out) {
+  int rank_best = -1;
+  double precision_best = 0;
+  for (int i = 0; i < TEST_SIZE_MAX; i++) {
+    if (!BP[i]) continue;
+    auto r = results[i];
+    double precision = 100 * double(r.takenCorrect + r.notTakenCorrect) /
+                       ((double) r.takenCorrect + (double) r.notTakenCorrect + (double) r.takenIncorrect +
+                        (double) r.notTakenIncorrect);
+
+    // cout << "result[" << i << "] name: " << r.name << endl
+    //      << "capacity: " << BP[i]->capacity_kib() << " KiB" << endl
+    //      << "takenCorrect: " << r.takenCorrect << endl
+    //      << "takenIncorrect: " << r.takenIncorrect << endl
+    //      << "notTakenCorrect: " << r.notTakenCorrect << endl
+    //      << "notTakenIncorrect: " << r.notTakenIncorrect << endl
+    //      << "Precision: " << precision << endl;
+    // if (r.takenPcCorrect != 0 || r.takenPcIncorrect != 0)
+    //   cout << "takenPcCorrect: " << r.takenPcCorrect << endl
+    //        << "takenPcIncorrect: " << r.takenPcIncorrect << endl
+    //        << "PcPrecision: "
+    //        << (100.0 * (double) r.takenPcCorrect / ((double) r.takenPcCorrect + (double) r.takenPcIncorrect))
+    //        << endl;
+
+    out.setf(ios::showbase);
+    out << "result[" << i << "] name: " << r.name << endl
+        << "capacity: " << BP[i]->capacity_kib() << " KiB" << endl
+        << "takenCorrect: " << r.takenCorrect << endl
+        << "takenIncorrect: " << r.takenIncorrect << endl
+        << "notTakenCorrect: " << r.notTakenCorrect << endl
+        << "notTakenIncorrect: " << r.notTakenIncorrect << endl
+        << "Precision: " << precision << endl;
+    if (r.takenPcCorrect != 0 || r.takenPcIncorrect != 0)
+      out << "takenPcCorrect: " << r.takenPcCorrect << endl
+          << "takenPcIncorrect: " << r.takenPcIncorrect << endl
+          << "PcPrecision: "
+          << (100.0 * (double) r.takenPcCorrect / ((double) r.takenPcCorrect + (double) r.takenPcIncorrect))
+          << endl;
+
+    delete BP[i];
+
+    if (precision > precision_best) {
+      precision_best = precision;
+      rank_best = i;
+    }
+  }
+  if (rank_best >= 0) {
+    auto best = results[rank_best];
+    cout << "Best: result[" << rank_best << "] " << best.name << " with precision " << precision_best << endl;
+    out << "Best: result[" << rank_best << "] " << best.name << " with precision " << precision_best << endl;
+  }
+}
+
+static int test_tail = 0;
+
+// Variadic so that template arguments may contain commas
+#define SET_TEST_PREDICTOR(index, ...) do {    \
+  BP[(index)] = (new __VA_ARGS__);             \
+  results[(index)].name = #__VA_ARGS__;        \
+} while (0)
+
+// Skipped once BP[] is full, setting test_overflow
+#define APPEND_TEST_PREDICTOR(...) do {    \
+  if (test_tail >= TEST_SIZE_MAX) {        \
+    test_overflow = true;                  \
+    break;                                 \
+  }                                        \
+  BP[(test_tail)] = (new __VA_ARGS__);     \
+  results[(test_tail)].name = #__VA_ARGS__; \
+  test_tail++;                             \
+} while (0)
+
+static bool test_overflow = false;
+
+/**
+ * Predictors under test, shared by the pintool and the replay
+ * @return false if they do not all fit in BP[], those that fit are added
+ */
+bool AddPredictors() {
+  test_overflow = false;
+  APPEND_TEST_PREDICTOR(BHTPredictor(14));
+  APPEND_TEST_PREDICTOR(Composed<Bimodal<17>>());
+  APPEND_TEST_PREDICTOR(Composed<GShare<20, 17>>());
+  APPEND_TEST_PREDICTOR(TournamentPredictor(new BHTPredictor(13),
+                                            new GlobalHistoryPredictor<HashMethods::fold_xor<20>>(20, 13)));
+  APPEND_TEST_PREDICTOR(Composed<Tournament<Bimodal<16>, GShare<20, 16>>>());
+  // Alpha 21264: local PAg against global GAg, chosen by the global history
+  APPEND_TEST_PREDICTOR(TournamentPredictor(new LocalHistoryPredictor(10, 10, 0, 3),
+                                            new GlobalHistoryPredictor<HashMethods::global>(12, 12, 2, false),
+                                            false, 12));
+
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<8>>(8, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<10>>(10, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<12>>(12, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<14>>(14, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<16>>(16, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<18>>(18, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<20>>(20, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<22>>(22, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<24>>(24, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<26>>(26, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<28>>(28, 17, 2, false));
+  // APPEND_TEST_PREDICTOR(GlobalHistoryPredictor<HashMethods::fold_xor<30>>(30, 17, 2, false));
+
+  APPEND_TEST_PREDICTOR(TAGEPredictor(12, 13, 4, 640, 10, 11));
+  APPEND_TEST_PREDICTOR(TAGESCLPredictor(new TAGEPredictor(12, 13, 4, 640, 10, 11),
+                                         LoopPredictor(6, 14, 10), StatisticalCorrector(6, 10, 3, 40, 6)));
+  APPEND_TEST_PREDICTOR(PerceptronPredictor(9, 63));
+  APPEND_TEST_PREDICTOR(HashedPerceptronPredictor(8, 12, 4, 256));
+  return !test_overflow;
+}
+
+/**
+ * Report predictors over the storage budget
+ * @param budget Bytes, 0 for no limit
+ * @return true if any predictor is oversize
+ */
+bool CheckCapacity(ostream &out, UINT32 budget) {
+  bool oversize = false;
+  for (int i = 0; i < TEST_SIZE_MAX; i++) {
+    auto t = BP[i];
+    if (!t) continue;
+    if (budget && t->capacity() > budget) {
+      out << "predictor[" << i << "] " << results[i].name << " oversize! capacity = " << t->capacity() << ", "
+          << t->capacity_kib() << " KiB" << endl;
+      cerr << "predictor[" << i << "] " << results[i].name << " oversize! capacity = " << t->capacity() << ", "
+           << t->capacity_kib() << " KiB" << endl;
+      oversize = true;
+    }
+  }
+  return oversize;
+}
+
+#endif //ARCH_LABS_BRCH_PREDICT_H
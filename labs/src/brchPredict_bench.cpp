@@ -0,0 +1,537 @@
+//
+// Synthetic branch patterns to check the predictors of brchPredict.h, natively
+// and without Pin.
+//
+// Every pattern generates a branch stream with a known best accuracy, runs it
+// through every predictor of a spec (brchSpec.h) and checks the accuracy
+// against the bounds of the pattern, after a warm-up. Indirect patterns go to
+// the target predictors of targetPredict.h. Throughput is reported as
+// branches per second of predict + update, to catch slowdowns of refactors.
+//
+// With -hashes, the index hashes of HashMethods are measured instead: the
+// share of (pc, history) contexts that share a table entry with another one,
+// against a random hash of the same table, and ns per index. Contexts are the
+// distinct ones of the conditional branches of -trace, or synthetic ones.
+// The fast fold_xor is checked against the 128-bit reference fold.
+//
+// Usage: brchPredict_bench [-branches n] [-predictors spec] [-pattern name,...] [-seed n] [-format md,json,csv]
+//        brchPredict_bench -hashes [-trace file] [-log n] [-seed n] [-format md,json,csv]
+// Exits with 1 if any accuracy is out of bounds or a fold differs; results of
+// -format go to brchPredict_bench.json/.csv.
+//
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include "brchPredict.h"
+#include "brchTrace.h"
+#include "targetPredict.h"
+#include "brchSpec.h"
+
+using namespace std;
+
+int Usage() {
+  cerr << "Usage: brchPredict_bench [-branches n] [-predictors spec] [-pattern name,...] [-seed n] [-format md,json,csv]"
+       << endl << "       brchPredict_bench -hashes [-trace file] [-log n] [-seed n] [-format md,json,csv]" << endl;
+  return 1;
+}
+
+// Base of the code of the synthetic program, pcs are 4-byte aligned like fixed length instructions
+static const ADDRINT CODE = 0x400000;
+
+// Predictors by what they can learn
+enum PredictorClass {
+  CLASS_NONE,                     // No history: BHT, bimodal
+  CLASS_LOCAL,                    // Local history only: two-level PAg / PAp
+  CLASS_CHOOSER,                  // Tournament, a chooser between a history predictor and another
+  CLASS_HISTORY,                  // Everything else
+  CLASS_RANDOM                    // StaticPredictor, only reported
+};
+
+/**
+ * One pattern: generates branches into a stream, with bounds of the accuracy
+ * of every class of predictors
+ */
+struct Pattern {
+  const char *name;
+  const char *description;
+  void (*generate)(vector<BranchRecord> &stream, size_t n, Xoshiro256 &rng);
+  double min[CLASS_HISTORY + 1];  // Lowest accuracy of each PredictorClass
+  double max;                     // Highest accuracy of every predictor, below 1 for unpredictable streams
+  // Tighter bounds of a class that depend on the generated stream, may be nullptr
+  void (*bounds)(const vector<BranchRecord> &stream, PredictorClass c, double &min, double &max);
+};
+
+static void branch(vector<BranchRecord> &stream, ADDRINT pc, bool taken, UINT8 kind = BranchCond) {
+  BranchRecord r;
+  r.pc = pc;
+  r.target = pc + 0x40;
+  r.taken = taken;
+  r.fallThrough = kind == BranchCond;
+  r.kind = kind;
+  r.size = 4;
+  stream.push_back(r);
+}
+
+// 64 branches, each taken 90% of the time at random
+static void biased(vector<BranchRecord> &stream, size_t n, Xoshiro256 &rng) {
+  while (stream.size() < n) branch(stream, CODE + 4 * rng.below(64), rng.below(10) != 0);
+}
+
+// One branch repeating a random pattern of period 8
+static void periodic(vector<BranchRecord> &stream, size_t n, Xoshiro256 &rng) {
+  bool period[8];
+  for (auto &p: period) p = rng.coin();
+  for (size_t i = 0; stream.size() < n; i++) branch(stream, CODE, period[i % 8]);
+}
+
+/*
+ * Without history the branch has one saturating counter, whose accuracy on
+ * the period is exact once it cycles: bound it by counters of 1 to 8 bits
+ * starting weak-taken. Not the majority of the period, as a counter can lose
+ * everything, e.g. on an alternating pattern.
+ */
+static void periodicBounds(const vector<BranchRecord> &stream, PredictorClass c, double &min, double &max) {
+  if (c != CLASS_NONE || stream.size() < 8) return;
+  min = 1;
+  max = 0;
+  for (int width = 1; width <= 8; width++) {
+    int top = (1 << width) - 1, init = (1 << width) / 2, counter = init, correct = 0;
+    for (size_t i = 0; i < 8 * 64; i++) {
+      bool taken = stream[i % 8].taken;
+      // Cycles within 2^width periods, count the last 32
+      if (i >= 8 * 32) correct += (counter >= init) == taken;
+      counter = taken ? std::min(counter + 1, top) : std::max(counter - 1, 0);
+    }
+    double accuracy = correct / (8.0 * 32);
+    min = std::min(min, accuracy);
+    max = std::max(max, accuracy);
+  }
+  min = std::max(min - 0.01, 0.0);
+  max = std::min(max + 0.01, 1.0);
+}
+
+// A random branch followed by one with the same outcome
+static void correlated(vector<BranchRecord> &stream, size_t n, Xoshiro256 &rng) {
+  while (stream.size() < n) {
+    bool a = rng.coin();
+    branch(stream, CODE, a);
+    branch(stream, CODE + 0x20, a);
+  }
+}
+
+// An inner loop of 7 iterations inside an outer one of 4, backward branches taken until the exit
+static void loops(vector<BranchRecord> &stream, size_t n, Xoshiro256 &rng) {
+  while (stream.size() < n)
+    for (int outer = 0; outer < 4; outer++) {
+      for (int inner = 0; inner < 7; inner++) branch(stream, CODE + 0x10, inner < 6);
+      branch(stream, CODE + 0x30, outer < 3);
+    }
+}
+
+// Fair coins at 16 branches, nothing to learn
+static void coins(vector<BranchRecord> &stream, size_t n, Xoshiro256 &rng) {
+  while (stream.size() < n) branch(stream, CODE + 4 * rng.below(16), rng.coin());
+}
+
+// An indirect jump cycling through 4 targets, and an indirect call whose target follows a conditional branch.
+// Targets differ in bits 2..11, those hashed into the ITTAGE history.
+static void indirect(vector<BranchRecord> &stream, size_t n, Xoshiro256 &rng) {
+  for (size_t i = 0; stream.size() < n; i++) {
+    branch(stream, CODE, true, BranchIndirect);
+    stream.back().target = CODE + 0x1000 + 0x150 * (i % 4);
+    bool c = rng.coin();
+    branch(stream, CODE + 0x100, c);
+    branch(stream, CODE + 0x200, true, BranchIndirectCall);
+    stream.back().target = c ? CODE + 0x8000 : CODE + 0x8240;
+    branch(stream, stream.back().target + 0x10, true, BranchReturn);
+    stream.back().target = CODE + 0x204;
+  }
+}
+
+// A single global chooser follows the last branch that told the sub-predictors apart, so it loses on mixed branches
+static const Pattern PATTERNS[] = {
+        {"biased",     "64 branches taken 90% at random",     biased,     {0.85, 0.85, 0.85, 0.85}, 0.92, nullptr},
+        {"periodic",   "1 branch of period 8",                periodic,   {0.0,  0.99, 0.99, 0.99}, 1.0,
+                periodicBounds},
+        {"correlated", "random branch, then one equal to it", correlated, {0.45, 0.45, 0.60, 0.74}, 0.76, nullptr},
+        {"loops",      "7 inner iterations in 4 outer",       loops,      {0.80, 0.99, 0.80, 0.96}, 1.0,  nullptr},
+        {"random",     "16 fair coins",                       coins,      {0.47, 0.47, 0.47, 0.47}, 0.53, nullptr},
+        {"indirect",   "4-target cycle and correlated call",  indirect,   {0.90, 0.90, 0.90, 0.90}, 1.0,  nullptr},
+};
+
+// Class of every kind of config(), a new kind must be added here
+static const pair<const char *, PredictorClass> KINDS[] = {
+        {"StaticPredictor",           CLASS_RANDOM},
+        {"BHTPredictor",              CLASS_NONE},
+        {"Bimodal",                   CLASS_NONE},
+        {"LocalHistoryPredictor",     CLASS_LOCAL},
+        {"TournamentPredictor",       CLASS_CHOOSER},
+        {"Tournament",                CLASS_CHOOSER},
+        {"GlobalHistoryPredictor",    CLASS_HISTORY},
+        {"GShare",                    CLASS_HISTORY},
+        {"SkewedPredictor",           CLASS_HISTORY},
+        {"TAGEPredictor",             CLASS_HISTORY},
+        {"TAGESCLPredictor",          CLASS_HISTORY},
+        {"PerceptronPredictor",       CLASS_HISTORY},
+        {"HashedPerceptronPredictor", CLASS_HISTORY},
+};
+
+/**
+ * @param kind Set to the kind of BP[i]
+ * @return false if the kind is not in KINDS
+ */
+static bool Classify(int i, PredictorClass &c, string &kind) {
+  ResultRecord r;
+  BP[i]->config(r);
+  kind = r.text("kind");
+  for (auto &k: KINDS)
+    if (kind == k.first) {
+      c = k.second;
+      return true;
+    }
+  return false;
+}
+
+/*
+ * Specs that must be rejected, and specs whose predictor must use at least
+ * the history asked for, e.g. when max is left to its default below min
+ */
+static const char *const INVALID_SPECS[] = {
+        "tage:min=4000,max=640", "tagescl:min=100,max=50", "hperceptron:min=300,max=256", "gshare:hash=none",
+};
+static const char *const HISTORY_SPECS[] = {"tage:min=4000", "tagescl:min=1000", "hperceptron:min=4000"};
+
+// @return the number of failed checks
+static int CheckSpecs(ResultWriter &writer) {
+  int failures = 0;
+  auto result = [&](const string &spec, const string &expected, bool ok) {
+    failures += ok ? 0 : 1;
+    cout << "  " << (ok ? "ok  " : "FAIL") << " " << expected << ": " << spec << endl;
+    ResultRecord r;
+    r.add("spec", spec).add("expected", expected).add("pass", ok);
+    writer.section("specs").push_back(r);
+  };
+  cout << "specs" << endl;
+  string error;
+  for (auto spec: INVALID_SPECS) {
+    bool rejected = !AddPredictorSpec(spec, error);
+    result(spec, "rejected", rejected);
+  }
+  for (auto spec: HISTORY_SPECS) {
+    bool ok = AddPredictorSpec(spec, error) && BP[test_tail - 1];
+    if (ok) {
+      ResultRecord r;
+      BP[test_tail - 1]->config(r);
+      // The first ones, "main.min_hist" of TAGE-SC-L before those of its corrector
+      string min, max;
+      for (auto &f: r.fields()) {
+        auto &k = f.first;
+        if (min.empty() && k.size() >= 8 && k.compare(k.size() - 8, 8, "min_hist") == 0) min = f.second;
+        if (max.empty() && k.size() >= 8 && k.compare(k.size() - 8, 8, "max_hist") == 0) max = f.second;
+      }
+      ok = !min.empty() && !max.empty() && strtoull(max.c_str(), nullptr, 0) >= strtoull(min.c_str(), nullptr, 0);
+    }
+    result(spec, "max_hist >= min_hist", ok);
+  }
+  for (int i = 0; i < TEST_SIZE_MAX; i++) {
+    delete BP[i];
+    BP[i] = nullptr;
+  }
+  test_tail = 0;
+  return failures;
+}
+
+struct Outcome {
+  double accuracy;
+  double rate;                    // Branches per second
+};
+
+// Direction accuracy of BP[i] on stream, counted after warmup branches
+static Outcome RunDirection(int i, const vector<BranchRecord> &stream, size_t warmup) {
+  auto P = BP[i];
+  UINT64 correct = 0, counted = 0, predicted = 0;
+  auto start = chrono::steady_clock::now();
+  for (size_t k = 0; k < stream.size(); k++) {
+    auto &b = stream[k];
+    if (!b.fallThrough) continue;
+    ADDRINT prediction = P->predict(b.pc);
+    P->update(b.taken, prediction, b.pc, b.target);
+    predicted++;
+    if (k < warmup) continue;
+    counted++;
+    correct += (prediction != 0) == b.taken;
+  }
+  chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+  return {counted ? (double) correct / (double) counted : 0, seconds.count() ? predicted / seconds.count() : 0};
+}
+
+// Target accuracy of taken indirect jumps, calls and returns, counted after warmup branches
+static Outcome RunTargets(const vector<BranchRecord> &stream, size_t warmup) {
+  AddTargetPredictor();
+  UINT64 before = 0;
+  auto start = chrono::steady_clock::now();
+  for (size_t k = 0; k < stream.size(); k++) {
+    if (k == warmup)
+      for (UINT8 kind = 0; kind <= BranchOther; kind++) if (kind != BranchCond) before += TP->stats(kind).correct;
+    auto &b = stream[k];
+    TP->access(b.pc, b.taken, b.target, b.kind, b.size);
+  }
+  chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+  UINT64 correct = 0, taken = 0;
+  for (UINT8 kind = 0; kind <= BranchOther; kind++)
+    if (kind != BranchCond) correct += TP->stats(kind).correct;
+  for (size_t k = warmup; k < stream.size(); k++) taken += stream[k].kind != BranchCond && stream[k].taken;
+  delete TP;
+  TP = nullptr;
+  return {taken ? (double) (correct - before) / (double) taken : 0,
+          seconds.count() ? stream.size() / seconds.count() : 0};
+}
+
+/* ===================================================================== */
+/* Index hashes                                                          */
+/* ===================================================================== */
+
+// Global history bits of a context, as the fold20 gshare of the tournament
+static const size_t HASH_HISTORY = 20;
+
+struct Context {
+  ADDRINT pc;
+  UINT64 history;
+
+  bool operator<(const Context &o) const { return pc != o.pc ? pc < o.pc : history < o.history; }
+
+  bool operator==(const Context &o) const { return pc == o.pc && history == o.history; }
+};
+
+// fold_xor as it was: 128 / bits slices of 128-bit arithmetic whatever the address
+template<int bits>
+static UINT128 ReferenceFold(UINT128 addr, UINT128 history) {
+  UINT128 r = 0;
+  for (int i = 0; i < 128; i += bits) {
+    r ^= (((UINT128) 1 << bits) - 1) & addr;
+    addr >>= bits;
+  }
+  return r ^ history;
+}
+
+// History xor-folded into n bits, as FoldedHistory keeps it
+static UINT64 Fold(UINT64 h, size_t n) {
+  UINT64 r = 0;
+  for (; h; h >>= n) r ^= truncate(h, n);
+  return r;
+}
+
+// One hash: the index of a context in a table of 2^n entries, in banks (1 or 3) of 2^n entries each
+struct IndexHash {
+  const char *name;
+  int banks;
+  UINT64 (*index)(const Context &c, size_t n, int bank);
+};
+
+static const IndexHash HASHES[] = {
+        {"fold20_reference", 1, [](const Context &c, size_t n, int) {
+          return (UINT64) truncate(ReferenceFold<20>(c.pc, c.history), n);
+        }},
+        {"fold20",           1, [](const Context &c, size_t n, int) {
+          return (UINT64) truncate(HashMethods::fold_xor<20>(c.pc, c.history), n);
+        }},
+        {"fold16",           1, [](const Context &c, size_t n, int) {
+          return (UINT64) truncate(HashMethods::fold_xor<16>(c.pc, c.history), n);
+        }},
+        {"slice",            1, [](const Context &c, size_t n, int) {
+          return (UINT64) truncate(HashMethods::slice(c.pc, c.history), n);
+        }},
+        {"xor",              1, [](const Context &c, size_t n, int) {
+          return (UINT64) truncate(HashMethods::hash_xor(c.pc, c.history), n);
+        }},
+        {"crc",              1, [](const Context &c, size_t n, int) {
+          return (UINT64) truncate(HashMethods::crc(c.pc, c.history), n);
+        }},
+        {"mix",              1, [](const Context &c, size_t n, int) {
+          return (UINT64) truncate(HashMethods::mix(c.pc, c.history), n);
+        }},
+        {"skew",             3, [](const Context &c, size_t n, int bank) {
+          return HashMethods::skew(bank, truncate(c.pc >> 2, n), Fold(c.history, n), n);
+        }},
+};
+
+// Distinct contexts of the conditional branches of a trace
+static bool TraceContexts(const string &file, vector<Context> &contexts) {
+  BranchTraceReader trace;
+  if (!trace.open(file)) return false;
+  BranchRecord r;
+  UINT64 ghr = 0;
+  while (trace.next(r)) {
+    if (!r.fallThrough) continue;
+    contexts.push_back({r.pc, ghr});
+    ghr = truncate((ghr << 1) | (r.taken ? 1 : 0), HASH_HISTORY);
+  }
+  sort(contexts.begin(), contexts.end());
+  contexts.erase(unique(contexts.begin(), contexts.end()), contexts.end());
+  return !trace.error();
+}
+
+// Half as many contexts as entries: 16 random histories of each branch, branches over 256 KiB of code
+static void SyntheticContexts(vector<Context> &contexts, size_t n, Xoshiro256 &rng) {
+  for (size_t b = 0; b < ((size_t) 1 << n) / 32; b++) {
+    ADDRINT pc = CODE + 4 * rng.below(0x10000);
+    for (int h = 0; h < 16; h++) contexts.push_back({pc, truncate(rng.next(), HASH_HISTORY)});
+  }
+  sort(contexts.begin(), contexts.end());
+  contexts.erase(unique(contexts.begin(), contexts.end()), contexts.end());
+}
+
+/**
+ * Share of the contexts that meet another one in their entry, in at least
+ * (banks + 1) / 2 banks: in the majority of a skewed predictor
+ */
+static double Aliasing(const IndexHash &h, const vector<Context> &contexts, size_t n) {
+  vector<UINT32> load((size_t) h.banks << n, 0);
+  for (auto &c: contexts)
+    for (int b = 0; b < h.banks; b++) load[((size_t) b << n) + h.index(c, n, b)]++;
+  UINT64 aliased = 0;
+  for (auto &c: contexts) {
+    int shared = 0;
+    for (int b = 0; b < h.banks; b++) shared += load[((size_t) b << n) + h.index(c, n, b)] > 1 ? 1 : 0;
+    aliased += shared >= (h.banks + 1) / 2 ? 1 : 0;
+  }
+  return contexts.empty() ? 0 : (double) aliased / (double) contexts.size();
+}
+
+// Aliasing of a random hash into independent banks
+static double IdealAliasing(int banks, UINT64 contexts, size_t n) {
+  double p = contexts ? 1 - pow(1 - 1.0 / (double) ((UINT64) 1 << n), (double) (contexts - 1)) : 0;
+  return banks == 1 ? p : 3 * p * p * (1 - p) + p * p * p;
+}
+
+// Nanoseconds per context of all the banks of h, call included, over at least 10M indices
+static double NsPerIndex(const IndexHash &h, const vector<Context> &contexts, size_t n, UINT64 &sink) {
+  size_t rounds = contexts.empty() ? 0 : 10000000 / contexts.size() + 1;
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+    for (auto &c: contexts)
+      for (int b = 0; b < h.banks; b++) sink += h.index(c, n, b);
+  chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+  return rounds ? 1e9 * seconds.count() / (double) (rounds * contexts.size()) : 0;
+}
+
+static int RunHashes(const string &trace, size_t n, const string &formats) {
+  vector<Context> contexts;
+  if (!trace.empty()) {
+    if (!TraceContexts(trace, contexts)) {
+      cerr << "Cannot read branch trace " << trace << endl;
+      return 1;
+    }
+  } else {
+    Xoshiro256 rng(random_seed);
+    SyntheticContexts(contexts, n, rng);
+  }
+  ResultWriter writer("brchPredict_bench", trace.empty() ? "synthetic" : trace);
+  int failures = 0;
+  for (auto &c: contexts)
+    if (HASHES[0].index(c, 64, 0) != HASHES[1].index(c, 64, 0)) failures++;
+  cout << fixed << setprecision(4) << contexts.size() << " contexts of " << HASH_HISTORY
+       << " history bits into 2^" << n << " entries per bank" << endl;
+  cout << (failures ? "FAIL" : "ok  ") << " fold_xor<20> equals the reference fold, " << failures << " differ" << endl;
+  UINT64 sink = 0;
+  for (auto &h: HASHES) {
+    double aliasing = Aliasing(h, contexts, n), ideal = IdealAliasing(h.banks, contexts.size(), n);
+    double ns = NsPerIndex(h, contexts, n, sink);
+    cout << "  " << setw(18) << left << h.name << right << " aliasing " << aliasing << " (random " << ideal
+         << "), " << setprecision(2) << ns << " ns/index" << setprecision(4) << endl;
+    ResultRecord r;
+    r.add("hash", h.name).add("banks", h.banks).add("entries_log", n).add("contexts", (UINT64) contexts.size())
+        .add("aliasing", aliasing).add("random_aliasing", ideal).add("ns_per_index", ns);
+    writer.section("hashes").push_back(r);
+  }
+  // Keeps the timed loops
+  if (sink == 42) cout << endl;
+  if (!writer.write(formats, "brchPredict_bench"))
+    cerr << "Cannot write results of formats " << formats << endl;
+  return failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n = 1000000, index_log = 12;
+  string spec = "default", patterns, formats = "md", trace;
+  bool hashes = false;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-branches" && i + 1 < argc) n = strtoull(argv[++i], nullptr, 0);
+    else if (arg == "-hashes") hashes = true;
+    else if (arg == "-trace" && i + 1 < argc) trace = argv[++i];
+    else if (arg == "-log" && i + 1 < argc) index_log = strtoull(argv[++i], nullptr, 0);
+    else if (arg == "-predictors" && i + 1 < argc) spec = argv[++i];
+    else if (arg == "-pattern" && i + 1 < argc) patterns = argv[++i];
+    else if (arg == "-seed" && i + 1 < argc) random_seed = strtoull(argv[++i], nullptr, 0);
+    else if (arg == "-format" && i + 1 < argc) formats = argv[++i];
+    else return Usage();
+  }
+  if (hashes) return index_log >= 2 && index_log <= 28 ? RunHashes(trace, index_log, formats) : Usage();
+  size_t warmup = n / 10;
+
+  ResultWriter writer("brchPredict_bench", "synthetic");
+  cout << fixed << setprecision(4);
+  int failures = CheckSpecs(writer);
+  for (auto &p: PATTERNS) {
+    if (!patterns.empty() && ("," + patterns + ",").find("," + string(p.name) + ",") == string::npos) continue;
+    // The stream of a pattern does not depend on the others selected
+    Xoshiro256 rng(random_seed + (UINT64) (&p - PATTERNS));
+    vector<BranchRecord> stream;
+    stream.reserve(n + 8);
+    p.generate(stream, n, rng);
+    cout << "pattern " << p.name << ": " << p.description << endl;
+    auto check = [&](const string &predictor, const Outcome &o, double min, double max) {
+      bool ok = o.accuracy >= min && o.accuracy <= max;
+      failures += ok ? 0 : 1;
+      cout << "  " << (ok ? "ok  " : "FAIL") << " accuracy " << o.accuracy << " in [" << min << ", " << max
+           << "], " << o.rate / 1e6 << " M branches/s, " << predictor << endl;
+      ResultRecord r;
+      r.add("pattern", p.name).add("predictor", predictor).add("accuracy", o.accuracy).add("min", min)
+          .add("max", max).add("pass", ok).add("branches_per_second", o.rate);
+      writer.section("results").push_back(r);
+    };
+    // Random predictors have nothing to check
+    auto report = [&](const string &predictor, const Outcome &o) {
+      cout << "  --   accuracy " << o.accuracy << ", not checked, " << o.rate / 1e6 << " M branches/s, " << predictor
+           << endl;
+      ResultRecord r;
+      r.add("pattern", p.name).add("predictor", predictor).add("accuracy", o.accuracy)
+          .add("branches_per_second", o.rate);
+      writer.section("results").push_back(r);
+    };
+    if (p.generate == indirect) {
+      check("TargetPredictor", RunTargets(stream, warmup), p.min[CLASS_HISTORY], p.max);
+      continue;
+    }
+    // Fresh predictors for every pattern
+    string error;
+    if (!AddPredictorSpec(spec, error)) {
+      cerr << "Invalid -predictors: " << error << endl;
+      return 1;
+    }
+    for (int i = 0; i < TEST_SIZE_MAX; i++) {
+      if (!BP[i]) continue;
+      PredictorClass c;
+      string kind;
+      if (!Classify(i, c, kind)) {
+        failures++;
+        cout << "  FAIL unknown predictor kind " << kind << ", " << results[i].name << endl;
+      } else if (c == CLASS_RANDOM) report(results[i].name, RunDirection(i, stream, warmup));
+      else {
+        double min = p.min[c], max = p.max;
+        if (p.bounds) p.bounds(stream, c, min, max);
+        check(results[i].name, RunDirection(i, stream, warmup), min, max);
+      }
+      delete BP[i];
+      BP[i] = nullptr;
+    }
+    test_tail = 0;
+  }
+  if (!writer.write(formats, "brchPredict_bench"))
+    cerr << "Cannot write results of formats " << formats << endl;
+  cout << (failures ? to_string(failures) + " checks failed" : "All checks passed") << endl;
+  return failures ? 1 : 0;
+}
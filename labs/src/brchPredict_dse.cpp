@@ -0,0 +1,324 @@
+//
+// Design-space exploration of the predictors of brchPredict.h on a branch trace.
+//
+// Candidates are spec strings (brchSpec.h) drawn from the parameter space of
+// each family, rejected when their capacity() is over the budget, and
+// evaluated in parallel on the conditional branches of the trace, which is
+// loaded once. Strategies:
+//   grid      every point of the space
+//   random    -samples points, uniformly
+//   hill      -samples restarts from random points, each moving to its best
+//             neighbour (one parameter one step away) while that improves
+// The Pareto front of direction precision against capacity is reported.
+//
+// Usage: brchPredict_dse <trace> [-family bht,gshare,...] [-strategy grid|random|hill] [-samples n]
+//     [-budget bytes] [-jobs n] [-seed n] [-limit branches] [-p program] [-format md,json,csv]
+// Results go to brchPredict_dse-<program>.txt (and .json/.csv).
+//
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <map>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "brchPredict.h"
+#include "brchTrace.h"
+#include "brchSpec.h"
+
+using namespace std;
+
+int Usage() {
+  cerr << "Usage: brchPredict_dse <trace> [-family bht,gshare,...] [-strategy grid|random|hill] [-samples n]" << endl
+       << "    [-budget bytes] [-jobs n] [-seed n] [-limit branches] [-p program] [-format md,json,csv]" << endl;
+  return 1;
+}
+
+struct Param {
+  const char *key;
+  vector<string> values;          // In increasing order, hill climbing steps to adjacent values
+};
+
+struct Family {
+  const char *kind;
+  vector<Param> params;
+};
+
+// Direction only, so targets do not count in capacities
+static const vector<Family> FAMILIES = {
+        {"bht",         {{"log", {"8", "9", "10", "11", "12", "13", "14", "15", "16", "17"}},
+                                {"scnt", {"2", "3"}}, {"addr", {"0"}}}},
+        {"gshare",      {{"hist", {"4", "8", "12", "16", "20", "24", "32", "48", "64"}},
+                                {"log", {"10", "11", "12", "13", "14", "15", "16", "17"}},
+                                {"scnt", {"2", "3"}}, {"addr", {"0"}}}},
+        {"gskew",       {{"hist", {"8", "12", "16", "20", "24", "32"}},
+                                {"log", {"9", "10", "11", "12", "13", "14", "15"}}, {"scnt", {"2", "3"}}}},
+        {"local",       {{"lht", {"6", "8", "10", "12"}}, {"hist", {"4", "6", "8", "10", "12", "14", "16"}},
+                                {"pc", {"0", "2", "4"}}, {"scnt", {"2", "3"}}}},
+        {"tournament",  {{"log0", {"10", "11", "12", "13", "14", "15", "16"}},
+                                {"hist", {"8", "12", "16", "20", "24"}},
+                                {"log1", {"10", "11", "12", "13", "14", "15", "16"}}, {"addr", {"0"}}}},
+        {"tage",        {{"tables", {"4", "6", "8", "10", "12"}}, {"t0", {"10", "11", "12", "13"}},
+                                {"max", {"64", "128", "256", "640"}}, {"log", {"8", "9", "10"}},
+                                {"tag", {"8", "9", "10", "11", "12"}}}},
+        {"perceptron",  {{"log", {"6", "7", "8", "9", "10"}}, {"hist", {"15", "31", "47", "63"}}}},
+        {"hperceptron", {{"tables", {"4", "6", "8", "10"}}, {"log", {"9", "10", "11", "12"}},
+                                {"max", {"64", "128", "256"}}}},
+};
+
+// A point of a family's space, one value index per parameter
+typedef vector<size_t> Point;
+
+class Explorer {
+public:
+  struct Candidate {
+    string spec;
+    UINT32 capacity = 0;
+    double precision = 0;
+  };
+
+private:
+  struct Branch {
+    ADDRINT pc;
+    ADDRINT target;
+    bool taken;
+  };
+
+  vector<Branch> m_branches;
+  UINT32 m_budget;
+  int m_jobs;
+  map<string, Candidate> m_done;  // Evaluated or rejected, by spec
+  UINT64 m_rejected = 0;
+
+  static string spec(const Family &f, const Point &p) {
+    string s = string(f.kind) + ":";
+    for (size_t i = 0; i < f.params.size(); i++)
+      s += (i ? "," : "") + string(f.params[i].key) + "=" + f.params[i].values[p[i]];
+    return s;
+  }
+
+  static BranchPredictor *create(const string &spec) {
+    auto colon = spec.find(':');
+    SpecParams p;
+    p.parse(spec.substr(colon + 1));
+    return CreatePredictor(spec.substr(0, colon), p);
+  }
+
+  double run(BranchPredictor *bp) const {
+    UINT64 correct = 0;
+    for (auto &b: m_branches) {
+      ADDRINT prediction = bp->predict(b.pc);
+      bp->update(b.taken, prediction, b.pc, b.target);
+      correct += (prediction != 0) == b.taken;
+    }
+    return m_branches.empty() ? 0 : (double) correct / (double) m_branches.size();
+  }
+
+public:
+  Explorer(UINT32 budget, int jobs) : m_budget(budget), m_jobs(jobs) {}
+
+  /**
+   * Load the conditional branches of a trace
+   * @param limit Branches to keep, 0 for all
+   */
+  bool load(const string &file, UINT64 limit) {
+    BranchTraceReader trace;
+    if (!trace.open(file)) return false;
+    BranchRecord r;
+    while ((!limit || m_branches.size() < limit) && trace.next(r))
+      if (r.fallThrough) m_branches.push_back({r.pc, r.target, r.taken});
+    return !trace.error();
+  }
+
+  UINT64 branches() const { return m_branches.size(); }
+
+  UINT64 rejected() const { return m_rejected; }
+
+  /**
+   * Evaluate the points not seen yet, in parallel
+   * @return the candidates of points, with precision 0 for those over the budget
+   */
+  vector<Candidate> evaluate(const Family &f, const vector<Point> &points) {
+    vector<Candidate> todo;
+    for (auto &p: points) {
+      auto s = spec(f, p);
+      if (m_done.count(s)) continue;
+      auto bp = create(s);
+      Candidate c;
+      c.spec = s;
+      c.capacity = bp->capacity();
+      delete bp;
+      if (m_budget && c.capacity > m_budget) {
+        m_rejected++;
+        m_done[s] = c;
+      } else if (find_if(todo.begin(), todo.end(), [&s](const Candidate &t) { return t.spec == s; }) == todo.end())
+        todo.push_back(c);
+    }
+    atomic<size_t> next{0};
+    auto worker = [this, &todo, &next]() {
+      for (size_t i; (i = next.fetch_add(1)) < todo.size();) {
+        auto bp = create(todo[i].spec);
+        todo[i].precision = run(bp);
+        delete bp;
+      }
+    };
+    vector<thread> threads;
+    for (int j = 0; j < m_jobs; j++) threads.emplace_back(worker);
+    for (auto &t: threads) t.join();
+    for (auto &c: todo) m_done[c.spec] = c;
+    vector<Candidate> out;
+    for (auto &p: points) out.push_back(m_done[spec(f, p)]);
+    return out;
+  }
+
+  void grid(const Family &f) {
+    vector<Point> points;
+    Point p(f.params.size(), 0);
+    for (;;) {
+      points.push_back(p);
+      size_t i = 0;
+      while (i < p.size() && ++p[i] == f.params[i].values.size()) p[i++] = 0;
+      if (i == p.size()) break;
+    }
+    evaluate(f, points);
+  }
+
+  static Point randomPoint(const Family &f, mt19937_64 &rng) {
+    Point p(f.params.size());
+    for (size_t i = 0; i < p.size(); i++) p[i] = rng() % f.params[i].values.size();
+    return p;
+  }
+
+  void random(const Family &f, size_t samples, mt19937_64 &rng) {
+    vector<Point> points;
+    for (size_t k = 0; k < samples; k++) points.push_back(randomPoint(f, rng));
+    evaluate(f, points);
+  }
+
+  void hill(const Family &f, size_t restarts, mt19937_64 &rng) {
+    for (size_t k = 0; k < restarts; k++) {
+      Point cur = randomPoint(f, rng);
+      auto best = evaluate(f, {cur})[0].precision;
+      for (;;) {
+        vector<Point> neighbours;
+        for (size_t i = 0; i < cur.size(); i++) {
+          if (cur[i] > 0) {
+            neighbours.push_back(cur);
+            neighbours.back()[i]--;
+          }
+          if (cur[i] + 1 < f.params[i].values.size()) {
+            neighbours.push_back(cur);
+            neighbours.back()[i]++;
+          }
+        }
+        auto results = evaluate(f, neighbours);
+        size_t arg = neighbours.size();
+        for (size_t n = 0; n < neighbours.size(); n++)
+          if (results[n].precision > best) {
+            best = results[n].precision;
+            arg = n;
+          }
+        if (arg == neighbours.size()) break;
+        cur = neighbours[arg];
+      }
+    }
+  }
+
+  // Evaluated candidates within the budget, by capacity
+  vector<Candidate> candidates() const {
+    vector<Candidate> out;
+    for (auto &d: m_done)
+      if (!m_budget || d.second.capacity <= m_budget) out.push_back(d.second);
+    sort(out.begin(), out.end(), [](const Candidate &a, const Candidate &b) {
+      return a.capacity != b.capacity ? a.capacity < b.capacity : a.precision > b.precision;
+    });
+    return out;
+  }
+
+  // Candidates no other one beats in both precision and capacity
+  vector<Candidate> pareto() const {
+    vector<Candidate> front;
+    for (auto &c: candidates())
+      if (front.empty() || c.precision > front.back().precision) front.push_back(c);
+    return front;
+  }
+};
+
+static ResultRecord record(const Explorer::Candidate &c) {
+  ResultRecord r;
+  r.add("spec", c.spec).add("capacity_bytes", c.capacity).add("capacity_kib", (double) c.capacity / 1024.0)
+      .add("precision", c.precision);
+  return r;
+}
+
+int main(int argc, char *argv[]) {
+  string trace_file, program, formats = "md", strategy = "grid", families;
+  size_t samples = 32;
+  UINT32 budget = 33 * 0x400;
+  int jobs = (int) thread::hardware_concurrency();
+  UINT64 seed = 1, limit = 0;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-p" && i + 1 < argc) program = argv[++i];
+    else if (arg == "-format" && i + 1 < argc) formats = argv[++i];
+    else if (arg == "-family" && i + 1 < argc) families = argv[++i];
+    else if (arg == "-strategy" && i + 1 < argc) strategy = argv[++i];
+    else if (arg == "-samples" && i + 1 < argc) samples = strtoul(argv[++i], nullptr, 0);
+    else if (arg == "-budget" && i + 1 < argc) budget = strtoul(argv[++i], nullptr, 0);
+    else if (arg == "-jobs" && i + 1 < argc) jobs = atoi(argv[++i]);
+    else if (arg == "-seed" && i + 1 < argc) seed = strtoull(argv[++i], nullptr, 0);
+    else if (arg == "-limit" && i + 1 < argc) limit = strtoull(argv[++i], nullptr, 0);
+    else if (arg[0] != '-' && trace_file.empty()) trace_file = arg;
+    else return Usage();
+  }
+  if (trace_file.empty() || (strategy != "grid" && strategy != "random" && strategy != "hill")) return Usage();
+  if (jobs < 1) jobs = 1;
+  if (program.empty()) {
+    program = trace_file.substr(trace_file.rfind('/') + 1);
+    if (program.find('.') != string::npos) program = program.substr(0, program.rfind('.'));
+  }
+
+  vector<const Family *> selected;
+  for (auto &f: FAMILIES)
+    if (families.empty() || ("," + families + ",").find("," + string(f.kind) + ",") != string::npos)
+      selected.push_back(&f);
+  if (selected.empty()) {
+    cerr << "No known family in " << families << endl;
+    return 1;
+  }
+
+  Explorer explorer(budget, jobs);
+  if (!explorer.load(trace_file, limit)) {
+    cerr << "Cannot read branch trace " << trace_file << endl;
+    return 1;
+  }
+  cerr << "Loaded " << explorer.branches() << " conditional branches, " << jobs << " jobs" << endl;
+
+  mt19937_64 rng(seed);
+  for (auto f: selected) {
+    cerr << "Exploring " << f->kind << " (" << strategy << ")" << endl;
+    if (strategy == "grid") explorer.grid(*f);
+    else if (strategy == "random") explorer.random(*f, samples, rng);
+    else explorer.hill(*f, samples, rng);
+  }
+
+  ofstream out(("brchPredict_dse-" + program + ".txt").c_str());
+  auto all = explorer.candidates();
+  auto front = explorer.pareto();
+  out << "Branches: " << explorer.branches() << ", budget: " << budget << " bytes, strategy: " << strategy
+      << ", evaluated: " << all.size() << ", over budget: " << explorer.rejected() << endl;
+  out << "Pareto front (capacity KiB, precision %, spec):" << endl;
+  for (auto &c: front)
+    out << "  " << (double) c.capacity / 1024.0 << "\t" << 100 * c.precision << "\t" << c.spec << endl;
+  if (!front.empty())
+    cout << "Best: " << front.back().spec << " with precision " << 100 * front.back().precision << " at "
+         << (double) front.back().capacity / 1024.0 << " KiB" << endl;
+
+  ResultWriter writer("brchPredict_dse", program);
+  for (auto &c: all) writer.section("candidates").push_back(record(c));
+  for (auto &c: front) writer.section("pareto").push_back(record(c));
+  if (!writer.write(formats, "brchPredict_dse-" + program))
+    cerr << "Cannot write results of formats " << formats << endl;
+  return 0;
+}
@@ -0,0 +1,135 @@
+//
+// Replay a branch trace captured by brchPredict -trace through the predictors
+// of brchPredict.h, natively and without Pin.
+//
+// Usage: brchPredict_replay <trace> [-p program] [-format md,json,csv] [-parallel] [-profile top] [-confidence]
+//     [-aliasing] [-predictors spec] [-budget bytes] [-seed n] [-delay branches] [-icount instructions [-timing] [-penalty cycles] [-fetch_width n]]
+// Traces hold no instruction count, -icount takes the one printed by the
+// pintool for MPKI and the timing model.
+// Results are written like the pintool does, to brchPredict-<program>.txt
+// (and .json/.csv), where program defaults to the trace name without extension.
+//
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "brchPredict.h"
+#include "brchTrace.h"
+#include "brchParallel.h"
+#include "targetPredict.h"
+#include "brchProfile.h"
+#include "brchConfidence.h"
+#include "brchAliasing.h"
+#include "brchTiming.h"
+#include "brchSpec.h"
+
+using namespace std;
+
+int Usage() {
+  cerr << "Usage: brchPredict_replay <trace> [-p program] [-format md,json,csv] [-parallel] [-profile top] [-confidence]" << endl
+       << "    [-aliasing] [-predictors spec] [-budget bytes] [-seed n] [-delay branches] [-icount instructions [-timing] [-penalty cycles] [-fetch_width n]]" << endl;
+  return 1;
+}
+
+static ParallelEvaluator evaluator;
+
+void spawnWorker(void (*func)(void *), void *arg) {
+  std::thread(func, arg).detach();
+}
+
+int main(int argc, char *argv[]) {
+  string trace_file, program, formats = "md";
+  bool parallel = false;
+  size_t top = 0;
+  string spec = "default";
+  UINT32 budget = 33 * 0x400;
+  bool timing = false, confident = false, aliased = false;
+  UINT32 penalty = 14, fetch_width = 4;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-parallel") parallel = true;
+    else if (arg == "-p" && i + 1 < argc) program = argv[++i];
+    else if (arg == "-format" && i + 1 < argc) formats = argv[++i];
+    else if (arg == "-profile" && i + 1 < argc) top = strtoul(argv[++i], nullptr, 0);
+    else if (arg == "-icount" && i + 1 < argc) instructions.count = strtoull(argv[++i], nullptr, 0);
+    else if (arg == "-timing") timing = true;
+    else if (arg == "-confidence") confident = true;
+    else if (arg == "-aliasing") aliased = true;
+    else if (arg == "-predictors" && i + 1 < argc) spec = argv[++i];
+    else if (arg == "-budget" && i + 1 < argc) budget = strtoul(argv[++i], nullptr, 0);
+    else if (arg == "-seed" && i + 1 < argc) random_seed = strtoull(argv[++i], nullptr, 0);
+    else if (arg == "-delay" && i + 1 < argc) update_delay = strtoul(argv[++i], nullptr, 0);
+    else if (arg == "-penalty" && i + 1 < argc) penalty = strtoul(argv[++i], nullptr, 0);
+    else if (arg == "-fetch_width" && i + 1 < argc) fetch_width = strtoul(argv[++i], nullptr, 0);
+    else if (arg[0] != '-' && trace_file.empty()) trace_file = arg;
+    else return Usage();
+  }
+  if (trace_file.empty()) return Usage();
+  if (program.empty()) {
+    program = trace_file.substr(trace_file.rfind('/') + 1);
+    if (program.find('.') != string::npos) program = program.substr(0, program.rfind('.'));
+  }
+
+  BranchTraceReader trace;
+  if (!trace.open(trace_file)) {
+    cerr << "Cannot read branch trace " << trace_file << endl;
+    return 1;
+  }
+
+  ofstream out(("brchPredict-" + program + ".txt").c_str());
+  string error;
+  if (!AddPredictorSpec(spec, error)) {
+    cerr << "Invalid -predictors: " << error << endl << "Statically composed predictors:" << endl;
+    ListStaticPredictors(cerr);
+    return 1;
+  }
+  AddTargetPredictor();
+  CheckCapacity(out, budget);
+  if (trace.version() < 2) cerr << "Branch trace " << trace_file << " has no call sizes, RAS results are invalid" << endl;
+
+  if (top) {
+    if (parallel) cerr << "Branch profile is not available with -parallel" << endl;
+    else profile.start(top);
+  }
+  if (confident) confidence.start();
+  if (aliased) aliasing.start();
+  if (parallel) evaluator.start(spawnWorker);
+  // Only branches with a fall-through path are predicted, as in the pintool
+  BranchRecord r;
+  UINT64 branches = 0, predicted = 0;
+  while (trace.next(r)) {
+    branches++;
+    TP->access(r.pc, r.taken, r.target, r.kind, r.size);
+    if (!r.fallThrough) continue;
+    if (parallel) evaluator.publish(r.pc, r.taken, r.target);
+    else if (profile.enabled()) profileBranch(r.pc, r.taken, r.target);
+    else predictBranch(r.pc, r.taken, r.target);
+    predicted++;
+  }
+  evaluator.stop();
+  if (trace.error()) cerr << "Branch trace " << trace_file << " is truncated" << endl;
+  cerr << "Replayed " << branches << " branches, " << predicted << " predicted" << endl;
+
+  FrontendModel model(penalty, fetch_width);
+  ResultWriter writer("brchPredict", program);
+  vector<int> predictors;
+  for (int i = 0; i < TEST_SIZE_MAX; i++) {
+    if (!BP[i]) continue;
+    predictors.push_back(i);
+    auto rec = recordResult(i);
+    if (instructions.count) model.record(rec, i, instructions.count, timing);
+    writer.section("results").push_back(rec);
+  }
+  RecordTargets(writer);
+  // Before the predictors are deleted
+  int best = BestPredictor();
+  confidence.report(out, writer.section("confidence"), predictors);
+  aliasing.report(out, writer.section("aliasing"), predictors);
+  ReportResults(out);
+  if (instructions.count) model.report(out, predictors, instructions.count, timing);
+  TP->report(out);
+  // No symbols in a trace
+  profile.report(out, writer.section("hotspots"), best, nullptr);
+  if (!writer.write(formats, "brchPredict-" + program))
+    cerr << "Cannot write results of formats " << formats << endl;
+  return trace.error() ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+//
+// Per static branch profile of the predictors in BP[].
+//
+// Every conditional branch gets one entry of an open-addressing hash table
+// keyed by pc (linear probing, grown at half load), with its executions,
+// taken count, direction transitions and the mispredictions of every
+// predictor. At the end the branches with the most mispredictions of the best
+// predictor are reported, symbolized through a callback so that this header
+// stays independent of Pin.
+//
+// Fed by profileBranch in place of predictBranch, so not with -parallel.
+//
+#ifndef ARCH_LABS_BRCH_PROFILE_H
+#define ARCH_LABS_BRCH_PROFILE_H
+
+#include <algorithm>
+#include "brchPredict.h"
+
+class BranchProfile {
+public:
+  struct Entry {
+    ADDRINT pc = 0;
+    UINT64 executions = 0;          // 0 marks an empty slot
+    UINT64 taken = 0;
+    UINT64 transitions = 0;         // Direction changes between consecutive executions
+    bool last_taken = false;
+  };
+
+  // @return "routine (file:line)" or similar for pc, empty if unknown
+  typedef string (*SYMBOLIZE)(ADDRINT pc);
+
+private:
+  vector<Entry> m_table;
+  vector<UINT32> m_miss;            // m_miss[slot * m_columns + column of predictor]
+  int m_column[TEST_SIZE_MAX];      // Column of every predictor in BP[], -1 if absent
+  size_t m_columns = 0;
+  size_t m_used = 0;
+  size_t m_mask = 0;
+  size_t m_top = 0;                 // Branches to report, 0 disables profiling
+
+  static size_t hash(ADDRINT pc) { return (size_t) ((pc * 0x9e3779b97f4a7c15ULL) >> 20); }
+
+  size_t probe(const vector<Entry> &table, size_t mask, ADDRINT pc) const {
+    size_t slot = hash(pc) & mask;
+    while (table[slot].executions && table[slot].pc != pc) slot = (slot + 1) & mask;
+    return slot;
+  }
+
+  void grow() {
+    size_t mask = m_mask * 2 + 1;
+    vector<Entry> table(mask + 1);
+    vector<UINT32> miss((mask + 1) * m_columns, 0);
+    for (size_t i = 0; i <= m_mask; i++) {
+      if (!m_table[i].executions) continue;
+      size_t slot = probe(table, mask, m_table[i].pc);
+      table[slot] = m_table[i];
+      copy_n(&m_miss[i * m_columns], m_columns, &miss[slot * m_columns]);
+    }
+    m_table.swap(table);
+    m_miss.swap(miss);
+    m_mask = mask;
+  }
+
+public:
+  bool enabled() const { return m_top != 0; }
+
+  size_t branches() const { return m_used; }
+
+  /**
+   * Start profiling the predictors now in BP[]
+   * @param top Branches to report
+   * @param entries_log log2 initial table size, grown as needed
+   */
+  void start(size_t top, size_t entries_log = 12) {
+    m_top = top;
+    m_columns = 0;
+    for (int i = 0; i < TEST_SIZE_MAX; i++) m_column[i] = BP[i] ? (int) m_columns++ : -1;
+    m_mask = ((size_t) 1 << entries_log) - 1;
+    m_table.assign(m_mask + 1, Entry());
+    m_miss.assign((m_mask + 1) * m_columns, 0);
+    m_used = 0;
+  }
+
+  /**
+   * Count one execution of the branch at pc
+   * @return slot of the branch, for mispredict()
+   */
+  size_t record(ADDRINT pc, BOOL taken) {
+    size_t slot = probe(m_table, m_mask, pc);
+    auto &e = m_table[slot];
+    if (!e.executions) {
+      if (2 * (m_used + 1) > m_mask + 1) {
+        grow();
+        return record(pc, taken);
+      }
+      m_used++;
+      e.pc = pc;
+    } else if (e.last_taken != (bool) taken) e.transitions++;
+    e.executions++;
+    e.taken += taken ? 1 : 0;
+    e.last_taken = taken;
+    return slot;
+  }
+
+  void mispredict(size_t slot, int predictor) { m_miss[slot * m_columns + m_column[predictor]]++; }
+
+  UINT32 misses(size_t slot, int predictor) const { return m_miss[slot * m_columns + m_column[predictor]]; }
+
+  // Slots of the branches with the most mispredictions of predictor, at most top
+  vector<size_t> hottest(int predictor) const {
+    vector<size_t> slots;
+    for (size_t i = 0; i <= m_mask; i++)
+      if (m_table[i].executions && misses(i, predictor)) slots.push_back(i);
+    auto order = [this, predictor](size_t a, size_t b) {
+      UINT32 ma = misses(a, predictor), mb = misses(b, predictor);
+      return ma != mb ? ma > mb : m_table[a].executions > m_table[b].executions;
+    };
+    size_t n = min(m_top, slots.size());
+    partial_sort(slots.begin(), slots.begin() + n, slots.end(), order);
+    slots.resize(n);
+    return slots;
+  }
+
+  /**
+   * Print the hottest branches of predictor and add them to rows
+   * @param symbolize Names pc, may be null
+   */
+  void report(ostream &out, vector<ResultRecord> &rows, int predictor, SYMBOLIZE symbolize) const {
+    if (!enabled() || predictor < 0 || m_column[predictor] < 0) return;
+    UINT64 total = 0;
+    for (size_t i = 0; i <= m_mask; i++)
+      if (m_table[i].executions) total += misses(i, predictor);
+    out << "Hard-to-predict branches of result[" << predictor << "] " << results[predictor].name << ", "
+        << m_used << " static branches, " << total << " mispredictions:" << endl;
+    for (auto slot: hottest(predictor)) {
+      auto &e = m_table[slot];
+      UINT32 miss = misses(slot, predictor);
+      string symbol = symbolize ? symbolize(e.pc) : "";
+      double miss_rate = (double) miss / (double) e.executions;
+      double taken_rate = (double) e.taken / (double) e.executions;
+      double share = total ? (double) miss / (double) total : 0.0;
+      char pc[24];
+      snprintf(pc, sizeof(pc), "0x%llx", (unsigned long long) e.pc);
+      out << "  " << pc << " executions: " << e.executions << ", mispredicts: " << miss
+          << " (" << 100 * miss_rate << "%, " << 100 * share << "% of all), taken: " << 100 * taken_rate
+          << "%, transitions: " << e.transitions;
+      if (!symbol.empty()) out << ", " << symbol;
+      out << endl;
+      ResultRecord r;
+      r.add("predictor", predictor).add("pc", pc).add("symbol", symbol).add("executions", e.executions)
+          .add("taken", e.taken).add("transitions", e.transitions).add("mispredicts", miss)
+          .add("mispredict_rate", miss_rate).add("mispredict_share", share);
+      rows.push_back(r);
+    }
+  }
+};
+
+static BranchProfile profile;
+
+// predictBranch, counting the branch and its mispredictions in the profile
+void profileBranch(ADDRINT pc, BOOL direction, ADDRINT target) {
+  size_t slot = profile.record(pc, direction);
+  for (int i = 0; i < TEST_SIZE_MAX; i++)
+    if (BP[i] && !predictOne(i, pc, direction, target)) profile.mispredict(slot, i);
+}
+
+#endif //ARCH_LABS_BRCH_PROFILE_H
@@ -0,0 +1,241 @@
+//
+// Predictor sets from a spec string, so that one binary serves all experiments.
+//
+// A spec is a ';' separated list of predictors, each a kind with optional
+// ','-separated key=value parameters:
+//   default;gshare:hist=20,log=17,addr=0;tage:tables=5,max=200
+// Kinds and their parameters, defaults as in the constructors:
+//   default       the set of AddPredictors()
+//   none          nothing, e.g. to only prepare a benchmark under Pin
+//   random        StaticPredictor
+//   bht           log=11 scnt=2 addr=1
+//   gshare        hist=8 log=11 scnt=2 addr=1 hash=fold20 (slice, global, xor, fold8, fold16, fold20, crc, mix)
+//                 path=0 fold=0, path history bits and the GHR folded into the index width
+//   gskew         hist=12 log=12 scnt=2, three skewed banks voting
+//   local         lht=10 hist=10 pc=0 scnt=3 addr=0, PAg or PAp with pc bits
+//   tournament    log0=13 hist=20 log1=13 addr=1 chooser=0, BHT against gshare
+//   alpha         lht=10 lhist=10 lscnt=3 ghist=12 chooser=12, local PAg against global GAg as the Alpha 21264
+//   tage          tables=12 t0=13 min=4 max=640 log=10 tag=11 ctr=3 reset=262144 u=2, max at least min
+//   tagescl       the tage keys, loop=6 sc_tables=6 sc_log=10
+//   perceptron    log=9 hist=63
+//   hperceptron   tables=8 log=12 min=4 max=256, max at least min
+// and every name of STATIC_PREDICTORS, without parameters.
+//
+#ifndef ARCH_LABS_BRCH_SPEC_H
+#define ARCH_LABS_BRCH_SPEC_H
+
+#include <deque>
+#include <map>
+#include "brchPredict.h"
+
+// Parameters of one predictor in a spec
+class SpecParams {
+  map<string, string> m_values;
+  map<string, bool> m_used;
+  string m_error;
+
+public:
+  /**
+   * @param params "key=value,key=value"
+   * @return false on a malformed parameter, see error()
+   */
+  bool parse(const string &params) {
+    size_t start = 0;
+    while (start < params.size()) {
+      size_t end = params.find(',', start);
+      if (end == string::npos) end = params.size();
+      auto item = params.substr(start, end - start);
+      auto eq = item.find('=');
+      if (eq == string::npos || eq == 0) {
+        m_error = "expected key=value, got \"" + item + "\"";
+        return false;
+      }
+      m_values[item.substr(0, eq)] = item.substr(eq + 1);
+      m_used[item.substr(0, eq)] = false;
+      start = end + 1;
+    }
+    return true;
+  }
+
+  const string &error() const { return m_error; }
+
+  void fail(const string &error) {
+    if (m_error.empty()) m_error = error;
+  }
+
+  // Numeric parameter key within [lo, hi], def if absent; an invalid value is reported by error()
+  size_t get(const string &key, size_t def, size_t lo = 0, size_t hi = ~(size_t) 0) {
+    auto it = m_values.find(key);
+    if (it == m_values.end()) return def;
+    m_used[key] = true;
+    char *end = nullptr;
+    auto v = (size_t) strtoull(it->second.c_str(), &end, 0);
+    if (it->second.empty() || *end || v < lo || v > hi) {
+      fail(key + "=" + it->second + " is not within [" + to_string(lo) + ", " + to_string(hi) + "]");
+      return def;
+    }
+    return v;
+  }
+
+  string getString(const string &key, const string &def) {
+    auto it = m_values.find(key);
+    if (it == m_values.end()) return def;
+    m_used[key] = true;
+    return it->second;
+  }
+
+  // Call after all get()s, unknown keys are errors
+  bool check() {
+    for (auto &u: m_used)
+      if (!u.second) fail("unknown parameter " + u.first);
+    return m_error.empty();
+  }
+};
+
+template<UINT128 (*hash)(UINT128 addr, UINT128 history)>
+BranchPredictor *createGShare(SpecParams &p) {
+  size_t hist = p.get("hist", 8, 1, 4096);
+  size_t log = p.get("log", 11, 1, 28);
+  size_t scnt = p.get("scnt", 2, 1, 8);
+  bool addr = p.get("addr", 1, 0, 1);
+  size_t path = p.get("path", 0, 0, 4096);
+  bool fold = p.get("fold", 0, 0, 1);
+  return new GlobalHistoryPredictor<hash>(hist, log, scnt, addr, path, fold);
+}
+
+BranchPredictor *createTAGE(SpecParams &p) {
+  size_t tables = p.get("tables", 12, 1, 32);
+  size_t t0 = p.get("t0", 13, 1, 24);
+  size_t min_hist = p.get("min", 4, 1, 4096);
+  size_t max_hist = p.get("max", std::max((size_t) 640, min_hist), min_hist, 4096);
+  size_t log = p.get("log", 10, 1, 24);
+  size_t tag = p.get("tag", 11, 2, 16);
+  size_t ctr = p.get("ctr", 3, 2, 7);
+  size_t reset = p.get("reset", 256 * 1024, 1);
+  size_t u = p.get("u", 2, 1, 7);
+  return new TAGEPredictor(tables, t0, min_hist, max_hist, log, tag, ctr, reset, u);
+}
+
+/**
+ * Create one predictor of a spec
+ * @param kind Kind, see the head of this file
+ * @return nullptr on an error, described by p.error() or an empty one for an unknown kind
+ */
+BranchPredictor *CreatePredictor(const string &kind, SpecParams &p) {
+  BranchPredictor *bp = nullptr;
+  if (kind == "random") bp = new StaticPredictor();
+  else if (kind == "bht") {
+    size_t log = p.get("log", 11, 1, 28);
+    size_t scnt = p.get("scnt", 2, 1, 8);
+    bp = new BHTPredictor(log, scnt, p.get("addr", 1, 0, 1));
+  } else if (kind == "gshare") {
+    auto hash = p.getString("hash", "fold20");
+    if (hash == "slice") bp = createGShare<HashMethods::slice>(p);
+    else if (hash == "global") bp = createGShare<HashMethods::global>(p);
+    else if (hash == "xor") bp = createGShare<HashMethods::hash_xor>(p);
+    else if (hash == "fold8") bp = createGShare<HashMethods::fold_xor<8>>(p);
+    else if (hash == "fold16") bp = createGShare<HashMethods::fold_xor<16>>(p);
+    else if (hash == "fold20") bp = createGShare<HashMethods::fold_xor<20>>(p);
+    else if (hash == "crc") bp = createGShare<HashMethods::crc>(p);
+    else if (hash == "mix") bp = createGShare<HashMethods::mix>(p);
+    else p.fail("unknown hash " + hash);
+  } else if (kind == "gskew") {
+    size_t hist = p.get("hist", 12, 1, 4096);
+    size_t log = p.get("log", 12, 2, 28);
+    bp = new SkewedPredictor(hist, log, p.get("scnt", 2, 1, 8));
+  } else if (kind == "tournament") {
+    size_t log0 = p.get("log0", 13, 1, 28);
+    size_t hist = p.get("hist", 20, 1, 4096);
+    size_t log1 = p.get("log1", 13, 1, 28);
+    bool addr = p.get("addr", 1, 0, 1);
+    size_t chooser = p.get("chooser", 0, 0, 28);
+    bp = new TournamentPredictor(new BHTPredictor(log0, 2, addr),
+                                 new GlobalHistoryPredictor<HashMethods::fold_xor<20>>(hist, log1, 2, addr), addr,
+                                 chooser);
+  } else if (kind == "local") {
+    size_t lht = p.get("lht", 10, 1, 24);
+    size_t hist = p.get("hist", 10, 1, 24);
+    size_t pc = p.get("pc", 0, 0, 24 - hist);
+    size_t scnt = p.get("scnt", 3, 1, 8);
+    bp = new LocalHistoryPredictor(lht, hist, pc, scnt, p.get("addr", 0, 0, 1));
+  } else if (kind == "alpha") {
+    size_t lht = p.get("lht", 10, 1, 24);
+    size_t lhist = p.get("lhist", 10, 1, 24);
+    size_t lscnt = p.get("lscnt", 3, 1, 8);
+    size_t ghist = p.get("ghist", 12, 1, 28);
+    size_t chooser = p.get("chooser", 12, 0, 28);
+    bp = new TournamentPredictor(new LocalHistoryPredictor(lht, lhist, 0, lscnt),
+                                 new GlobalHistoryPredictor<HashMethods::global>(ghist, ghist, 2, false), false,
+                                 chooser);
+  } else if (kind == "tage") bp = createTAGE(p);
+  else if (kind == "tagescl") {
+    auto tage = createTAGE(p);
+    size_t loop = p.get("loop", 6, 1, 16);
+    size_t sc_tables = p.get("sc_tables", 6, 1, 16);
+    size_t sc_log = p.get("sc_log", 10, 1, 24);
+    bp = new TAGESCLPredictor(tage, LoopPredictor(loop), StatisticalCorrector(sc_tables, sc_log));
+  } else if (kind == "perceptron") {
+    size_t log = p.get("log", 9, 1, 20);
+    bp = new PerceptronPredictor(log, p.get("hist", 63, 1, 1024));
+  } else if (kind == "hperceptron") {
+    size_t tables = p.get("tables", 8, 2, 32);
+    size_t log = p.get("log", 12, 1, 24);
+    size_t min_hist = p.get("min", 4, 1, 4096);
+    size_t max_hist = p.get("max", std::max((size_t) 256, min_hist), min_hist, 4096);
+    bp = new HashedPerceptronPredictor(tables, log, min_hist, max_hist);
+  } else if (auto e = FindStaticPredictor(kind)) bp = e->create();
+  if (bp && !p.check()) {
+    delete bp;
+    return nullptr;
+  }
+  return bp;
+}
+
+// Spec strings of the predictors appended by AddPredictorSpec, results[].name points into it
+static deque<string> spec_names;
+
+/**
+ * Append the predictors of spec to the predictors under test
+ * @param error Set to the reason of a failure
+ * @return false if the spec is invalid or BP[] is full
+ */
+bool AddPredictorSpec(const string &spec, string &error) {
+  size_t start = 0;
+  while (start <= spec.size()) {
+    size_t end = spec.find(';', start);
+    if (end == string::npos) end = spec.size();
+    auto item = spec.substr(start, end - start);
+    start = end + 1;
+    if (item.empty() || item == "none") continue;
+    if (item == "default") {
+      if (!AddPredictors()) {
+        error = item + ": more than " + to_string(TEST_SIZE_MAX) + " predictors";
+        return false;
+      }
+      continue;
+    }
+    auto colon = item.find(':');
+    auto kind = item.substr(0, colon);
+    SpecParams p;
+    if (colon != string::npos && !p.parse(item.substr(colon + 1))) {
+      error = item + ": " + p.error();
+      return false;
+    }
+    if (test_tail >= TEST_SIZE_MAX) {
+      error = item + ": more than " + to_string(TEST_SIZE_MAX) + " predictors";
+      return false;
+    }
+    auto bp = CreatePredictor(kind, p);
+    if (!bp) {
+      error = item + ": " + (p.error().empty() ? "unknown predictor " + kind : p.error());
+      return false;
+    }
+    spec_names.push_back(item);
+    BP[test_tail] = bp;
+    results[test_tail].name = spec_names.back().c_str();
+    test_tail++;
+  }
+  return true;
+}
+
+#endif //ARCH_LABS_BRCH_SPEC_H
@@ -0,0 +1,85 @@
+//
+// Mispredictions per kilo-instruction and a simple frontend timing model.
+//
+// The model charges every instruction 1 / fetch_width cycles and every
+// misprediction a fixed penalty, the cycles to refill the pipeline from the
+// redirected fetch:
+//   cycles = instructions / fetch_width + mispredicts * penalty
+// A misprediction is a wrong direction, or a wrong target of a taken branch
+// for predictors that predict targets. Everything else, caches included, is
+// taken as perfect, so only differences between predictors are meaningful.
+//
+#ifndef ARCH_LABS_BRCH_TIMING_H
+#define ARCH_LABS_BRCH_TIMING_H
+
+#include "brchPredict.h"
+
+// Instructions executed while the predictors were measured
+class InstructionCounter {
+  UINT64 m_base = 0;
+  double m_weighted = 0;
+
+public:
+  UINT64 count = 0;
+
+  // SimPoint, as in TestResult
+  void beginInterval() { m_base = count; }
+
+  void endInterval(double weight) { m_weighted += weight * (double) (count - m_base); }
+
+  void applyWeights(double scale) { count = (UINT64) llround(m_weighted * scale); }
+};
+
+static InstructionCounter instructions;
+
+class FrontendModel {
+  UINT32 m_penalty;
+  UINT32 m_fetch_width;
+
+public:
+  // param:   penalty:      Cycles lost per misprediction
+  //          fetch_width:  Instructions fetched per cycle
+  FrontendModel(UINT32 penalty = 14, UINT32 fetch_width = 4)
+          : m_penalty(penalty), m_fetch_width(fetch_width ? fetch_width : 1) {}
+
+  static UINT64 mispredicts(int i) {
+    auto &r = results[i];
+    return r.takenIncorrect + r.notTakenIncorrect + r.takenPcIncorrect;
+  }
+
+  double baseCycles(UINT64 icount) const { return (double) icount / m_fetch_width; }
+
+  double lostCycles(int i) const { return (double) mispredicts(i) * m_penalty; }
+
+  static double mpki(int i, UINT64 icount) { return icount ? 1000.0 * (double) mispredicts(i) / (double) icount : 0; }
+
+  double cpi(int i, UINT64 icount) const {
+    return icount ? (baseCycles(icount) + lostCycles(i)) / (double) icount : 0;
+  }
+
+  // MPKI of predictor i, and its cycles when timing
+  void record(ResultRecord &rec, int i, UINT64 icount, bool timing) const {
+    rec.add("instructions", icount).add("mispredicts", mispredicts(i)).add("mpki", mpki(i, icount));
+    if (timing)
+      rec.add("penalty", m_penalty).add("fetch_width", m_fetch_width).add("lost_cycles", lostCycles(i))
+          .add("cycles", baseCycles(icount) + lostCycles(i)).add("cpi", cpi(i, icount));
+  }
+
+  /**
+   * Print MPKI of every predictor in results[] and, when timing, the cycles it loses
+   * @param predictors Indices to report, BP[] may already be deleted
+   */
+  void report(ostream &out, const vector<int> &predictors, UINT64 icount, bool timing) const {
+    out << "Instructions: " << icount << endl;
+    if (timing)
+      out << "Frontend model: penalty " << m_penalty << " cycles, fetch width " << m_fetch_width
+          << ", perfect CPI " << (icount ? baseCycles(icount) / (double) icount : 0) << endl;
+    for (int i: predictors) {
+      out << "timing[" << i << "] mispredicts: " << mispredicts(i) << ", MPKI: " << mpki(i, icount);
+      if (timing) out << ", lost cycles: " << lostCycles(i) << ", CPI: " << cpi(i, icount);
+      out << endl;
+    }
+  }
+};
+
+#endif //ARCH_LABS_BRCH_TIMING_H
@@ -0,0 +1,189 @@
+//
+// Compressed branch trace, written by brchPredict -trace and read by brchPredict_replay.
+//
+// File layout: "BRTRACE" magic, one version byte, then one record per executed
+// control-flow instruction:
+//   flags   1 byte, bit 0 taken, bit 1 has fall-through, bits 2..4 BranchKind
+//   pc      zigzag varint of (pc - pc of the previous record)
+//   target  zigzag varint of (target - pc)
+//   size    1 byte, instruction length, calls only (version 2), for return addresses
+// Loops and direct branches keep both deltas to one or two bytes per field.
+// Only stdio is used, so this header builds both under PinCRT and natively.
+//
+#ifndef ARCH_LABS_BRCH_TRACE_H
+#define ARCH_LABS_BRCH_TRACE_H
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#define BRANCH_TRACE_VERSION 2
+
+enum BranchKind {
+  BranchCond,             // Conditional direct branch
+  BranchJump,             // Unconditional direct jump
+  BranchIndirect,         // Indirect jump
+  BranchCall,             // Direct call
+  BranchIndirectCall,
+  BranchReturn,
+  BranchOther
+};
+
+static inline const char *branchKindName(uint8_t kind) {
+  static const char *names[] = {"cond", "jump", "indirect", "call", "indirect_call", "return", "other"};
+  return kind < BranchOther ? names[kind] : names[BranchOther];
+}
+
+class BranchRecord {
+public:
+  uint64_t pc = 0;
+  uint64_t target = 0;
+  bool taken = false;
+  bool fallThrough = false;     // Conditional in the sense of the live tool, which predicts only these
+  uint8_t kind = BranchOther;
+  uint8_t size = 0;             // Instruction length of calls, 0 if unknown
+};
+
+static inline bool branchIsCall(uint8_t kind) { return kind == BranchCall || kind == BranchIndirectCall; }
+
+class BranchTraceWriter {
+  FILE *m_fp = nullptr;
+  uint64_t m_last_pc = 0;
+  uint64_t m_records = 0;
+  uint8_t m_buf[1 << 16];
+  size_t m_len = 0;
+
+  void flush() {
+    if (m_len) fwrite(m_buf, 1, m_len, m_fp);
+    m_len = 0;
+  }
+
+  void putVarint(uint64_t v) {
+    while (v >= 0x80) {
+      m_buf[m_len++] = (uint8_t) (v | 0x80);
+      v >>= 7;
+    }
+    m_buf[m_len++] = (uint8_t) v;
+  }
+
+  static uint64_t zigzag(int64_t v) { return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63); }
+
+public:
+  ~BranchTraceWriter() { close(); }
+
+  bool open(const std::string &filename) {
+    m_fp = fopen(filename.c_str(), "wb");
+    if (!m_fp) return false;
+    fwrite("BRTRACE", 1, 7, m_fp);
+    fputc(BRANCH_TRACE_VERSION, m_fp);
+    return true;
+  }
+
+  bool isOpen() const { return m_fp != nullptr; }
+
+  uint64_t records() const { return m_records; }
+
+  void write(uint64_t pc, uint64_t target, bool taken, bool fall_through, uint8_t kind, uint8_t size = 0) {
+    // A record takes at most 1 + 10 + 10 + 1 bytes
+    if (m_len + 22 > sizeof(m_buf)) flush();
+    m_buf[m_len++] = (uint8_t) (taken | (fall_through << 1) | (kind << 2));
+    putVarint(zigzag((int64_t) (pc - m_last_pc)));
+    putVarint(zigzag((int64_t) (target - pc)));
+    if (branchIsCall(kind)) m_buf[m_len++] = size;
+    m_last_pc = pc;
+    m_records++;
+  }
+
+  void close() {
+    if (!m_fp) return;
+    flush();
+    fclose(m_fp);
+    m_fp = nullptr;
+  }
+};
+
+class BranchTraceReader {
+  FILE *m_fp = nullptr;
+  uint64_t m_last_pc = 0;
+  uint8_t m_version = 0;
+  uint8_t m_buf[1 << 16];
+  size_t m_pos = 0;
+  size_t m_len = 0;
+  bool m_error = false;
+
+  bool getByte(uint8_t &b) {
+    if (m_pos == m_len) {
+      m_len = fread(m_buf, 1, sizeof(m_buf), m_fp);
+      m_pos = 0;
+      if (!m_len) return false;
+    }
+    b = m_buf[m_pos++];
+    return true;
+  }
+
+  bool getVarint(uint64_t &v) {
+    v = 0;
+    uint8_t b;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (!getByte(b)) return false;
+      v |= (uint64_t) (b & 0x7f) << shift;
+      if (!(b & 0x80)) return true;
+    }
+    return false;
+  }
+
+  static int64_t unzigzag(uint64_t v) { return (int64_t) (v >> 1) ^ -(int64_t) (v & 1); }
+
+public:
+  ~BranchTraceReader() {
+    if (m_fp) fclose(m_fp);
+  }
+
+  /**
+   * Open a trace and check its header
+   * @return false if the file cannot be read or is not a branch trace of a known version
+   */
+  bool open(const std::string &filename) {
+    m_fp = fopen(filename.c_str(), "rb");
+    if (!m_fp) return false;
+    char magic[8];
+    if (fread(magic, 1, 8, m_fp) != 8 || memcmp(magic, "BRTRACE", 7) != 0) return false;
+    m_version = (uint8_t) magic[7];
+    return m_version >= 1 && m_version <= BRANCH_TRACE_VERSION;
+  }
+
+  // Version 1 traces have no call sizes
+  uint8_t version() const { return m_version; }
+
+  // Whether reading stopped at a truncated record
+  bool error() const { return m_error; }
+
+  /**
+   * Read the next record
+   * @return false at the end of the trace
+   */
+  bool next(BranchRecord &r) {
+    uint8_t flags;
+    if (!getByte(flags)) return false;
+    uint64_t pc_delta, target_delta;
+    if (!getVarint(pc_delta) || !getVarint(target_delta)) {
+      m_error = true;
+      return false;
+    }
+    r.pc = m_last_pc + (uint64_t) unzigzag(pc_delta);
+    r.target = r.pc + (uint64_t) unzigzag(target_delta);
+    r.taken = flags & 1;
+    r.fallThrough = (flags >> 1) & 1;
+    r.kind = (flags >> 2) & 0x7;
+    r.size = 0;
+    if (m_version >= 2 && branchIsCall(r.kind) && !getByte(r.size)) {
+      m_error = true;
+      return false;
+    }
+    m_last_pc = r.pc;
+    return true;
+  }
+};
+
+#endif //ARCH_LABS_BRCH_TRACE_H
@@ -6,8 +6,14 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <map>
+#include <set>
+#include <unordered_map>
 #include "debug_macros.h"
 #include "pin.H"
+#include "region.h"
+#include "results.h"
+#include "prng.h"
 
 using namespace std;
 
@@ -90,6 +96,8 @@ public:
   virtual size_t select(bool update) = 0;
 
   virtual size_t capacity() = 0;
+
+  virtual const char *name() = 0;
 };
 
 class LRURepl : public ReplaceAlgo {
@@ -113,6 +121,8 @@ public:
     if (l > 0) l--;
     return l * total;
   }
+  const char *name() override { return "LRURepl"; }
+
 };
 
 class PLRURepl : public ReplaceAlgo {
@@ -149,6 +159,8 @@ public:
   size_t capacity() override {
     return total - 1;
   }
+  const char *name() override { return "PLRURepl"; }
+
 
   ~PLRURepl() override {
     delete bits;
@@ -156,16 +168,19 @@ public:
 };
 
 class RandomRepl : public ReplaceAlgo {
+  Xoshiro256 rng;
 public:
   explicit RandomRepl(size_t total) : ReplaceAlgo(total) {}
 
   size_t select(bool update) override {
-    return rand() % total;
+    return rng.below(total);
   }
 
   size_t capacity() override {
     return 0;
   }
+  const char *name() override { return "RandomRepl"; }
+
 };
 
 class FIFORepl : public ReplaceAlgo {
@@ -187,6 +202,8 @@ public:
     if (l > 0) l--;
     return l;
   }
+  const char *name() override { return "FIFORepl"; }
+
 };
 
 /**
@@ -202,13 +219,25 @@ protected:
   UINT64 m_rd_hits;       // The number of hit read-requests
   UINT64 m_wr_hits;       // The number of hit write-requests
 
+  static const int COUNTER_NUM = 4;
+  // SimPoint: counters at the start of the current interval, weighted sums of measured intervals
+  UINT64 m_interval_base[COUNTER_NUM] = {0};
+  double m_weighted[COUNTER_NUM] = {0};
+
+  template<typename F>
+  void forEachCounter(F const &f) {
+    UINT64 *counters[COUNTER_NUM] = {&m_rd_reqs, &m_wr_reqs, &m_rd_hits, &m_wr_hits};
+    for (int i = 0; i < COUNTER_NUM; i++) f(i, *counters[i]);
+  }
+
 public:
   string name;
+  const string kind;      // Class of the model, name is replaced by setName
 
   // Constructor
   CacheModel(UINT32 block_num, UINT32 log_block_size, string name = "Basic model")
       : m_block_num(block_num), m_blksz_log(log_block_size),
-        m_rd_reqs(0), m_wr_reqs(0), m_rd_hits(0), m_wr_hits(0), name(std::move(name)) {
+        m_rd_reqs(0), m_wr_reqs(0), m_rd_hits(0), m_wr_hits(0), name(name), kind(name) {
   }
 
   virtual ~CacheModel() = default;
@@ -219,18 +248,58 @@ public:
     this->name = name_;
   }
 
-  // Update the cache state whenever data is read
-  void readReq(UINT32 mem_addr) {
+  void beginInterval() {
+    forEachCounter([this](int i, UINT64 &c) { m_interval_base[i] = c; });
+  }
+
+  void endInterval(double weight) {
+    forEachCounter([this, weight](int i, UINT64 &c) { m_weighted[i] += weight * (double) (c - m_interval_base[i]); });
+  }
+
+  // Replace counters with the whole-run estimation
+  void applyWeights(double scale) {
+    forEachCounter([this, scale](int i, UINT64 &c) { c = (UINT64) llround(m_weighted[i] * scale); });
+  }
+
+  UINT32 blockSizeLog() const { return m_blksz_log; }
+
+  // Update the cache state whenever data is read, return true on hit
+  bool readReq(UINT32 mem_addr) {
     m_rd_reqs++;
     // Dbg("R [%6lu] %08x", m_rd_reqs, mem_addr);
-    if (access(mem_addr)) m_rd_hits++;
+    if (!access(mem_addr)) return false;
+    m_rd_hits++;
+    return true;
   }
 
-  // Update the cache state whenever data is written
-  void writeReq(UINT32 mem_addr) {
+  // Update the cache state whenever data is written, return true on hit
+  bool writeReq(UINT32 mem_addr) {
     m_wr_reqs++;
     // Dbg("W [%6lu] %08x", m_wr_reqs, mem_addr);
-    if (access(mem_addr)) m_wr_hits++;
+    if (!access(mem_addr)) return false;
+    m_wr_hits++;
+    return true;
+  }
+
+  // Configuration fields for structured results
+  virtual void config(ResultRecord &r) {
+    r.add("kind", kind).add("block_num", m_block_num).add("block_size_log", m_blksz_log);
+  }
+
+  // Full result row: configuration, counters and capacity
+  ResultRecord record() {
+    ResultRecord r;
+    r.add("model", name);
+    config(r);
+    auto reqs = m_rd_reqs + m_wr_reqs;
+    auto hits = m_rd_hits + m_wr_hits;
+    r.add("read_reqs", m_rd_reqs).add("read_hits", m_rd_hits)
+        .add("write_reqs", m_wr_reqs).add("write_hits", m_wr_hits)
+        .add("misses", reqs - hits)
+        .add("miss_rate", reqs ? (double) (reqs - hits) / (double) reqs : 0.0)
+        .add("capacity_bits", (UINT64) capacity())
+        .add("capacity_kib", (double) capacity() / 8 / 0x400);
+    return r;
   }
 
 #pragma clang diagnostic push
@@ -402,6 +471,8 @@ public:
   ReplaceAlgo **replace;
   bool phy_index;
   bool phy_tag;
+  // Victims without a replacement algorithm
+  Xoshiro256 rng;
 
   // Constructor
   SetAssoCache(UINT32 sets_log, UINT32 log_block_size, UINT32 asso, string name = "SetAssoCache",
@@ -439,6 +510,12 @@ public:
     return s;
   }
 
+  void config(ResultRecord &r) override {
+    r.add("kind", kind).add("sets_log", m_sets_log).add("block_size_log", m_blksz_log).add("asso", m_asso)
+        .add("replacement", replace ? replace[0]->name() : "RandomRepl")
+        .add("phy_index", phy_index).add("phy_tag", phy_tag);
+  }
+
   template<typename F>
   void setReplace(F const &f) {
     if (!this->replace) this->replace = new ReplaceAlgo *[1 << m_sets_log];
@@ -493,7 +570,7 @@ private:
     } else {
       // kick out one block
       // Assert(replace, "must set replace algorithm");
-      auto select = replace ? replace[index_set]->select(true) : (rand() % m_asso);
+      auto select = replace ? replace[index_set]->select(true) : rng.below(m_asso);
       auto set = sets[select];
       set->m_tags[index_set] = tag;
       set->m_valids[index_set] = true;
@@ -547,7 +624,274 @@ public:
 private:
 };
 
+/**
+ * Split L1 instruction / data caches backed by a unified L2, write-allocate
+ */
+class CacheHierarchy {
+public:
+  CacheModel *l1i;
+  CacheModel *l1d;
+  CacheModel *l2;
+
+  CacheHierarchy(CacheModel *l1i, CacheModel *l1d, CacheModel *l2) : l1i(l1i), l1d(l1d), l2(l2) {}
+
+  ~CacheHierarchy() {
+    for (auto level: levels()) delete level;
+  }
+
+  vector<CacheModel *> levels() const { return {l1i, l1d, l2}; }
+
+  // Return true on L1I hit
+  bool fetch(UINT32 addr) {
+    if (l1i->readReq(addr)) return true;
+    l2->readReq(addr);
+    return false;
+  }
+
+  void read(UINT32 addr) {
+    if (!l1d->readReq(addr)) l2->readReq(addr);
+  }
+
+  void write(UINT32 addr) {
+    if (!l1d->writeReq(addr)) l2->writeReq(addr);
+  }
+};
+
+/**
+ * Code touched in one image
+ */
+class ImageFootprint {
+public:
+  string name;
+  set<UINT64> lines;              // Distinct instruction lines instrumented
+  UINT64 fetches = 0;             // Line fetches
+  UINT64 misses = 0;              // L1I misses in the hierarchy
+
+  explicit ImageFootprint(string name) : name(std::move(name)) {}
+};
+
+/**
+ * LRU stack distance profiler (Mattson): one pass gives the miss ratio of a
+ * fully associative LRU cache of every capacity.
+ * The distance of an access is the number of distinct lines touched since the
+ * previous access to the same line, counted with a Fenwick tree over access
+ * times; times are renumbered when the tree is full.
+ */
+class StackDistanceProfiler {
+  UINT32 m_blksz_log;
+  UINT32 m_max_log;                       // Largest capacity is 2^m_max_log lines
+  unordered_map<UINT64, UINT64> m_last;   // line -> time of its last access
+  vector<INT32> m_tree;                   // Fenwick tree, 1 at the last access time of each line
+  UINT64 m_now = 0;
+  vector<UINT64> m_hist;                  // [0]: distance 0, [b]: distance in [2^(b-1), 2^b)
+  UINT64 m_cold = 0;
+  UINT64 m_total = 0;
+
+  void mark(UINT64 t, INT32 v) {
+    for (t++; t < m_tree.size(); t += t & (~t + 1)) m_tree[t] += v;
+  }
+
+  // Marks in [0, t)
+  UINT64 prefix(UINT64 t) {
+    INT64 r = 0;
+    for (; t > 0; t -= t & (~t + 1)) r += m_tree[t];
+    return (UINT64) r;
+  }
+
+  void compact() {
+    vector<pair<UINT64, UINT64>> live(m_last.begin(), m_last.end());
+    sort(live.begin(), live.end(), [](auto &a, auto &b) { return a.second < b.second; });
+    size_t size = std::max<size_t>(m_tree.size(), live.size() * 4 + 1);
+    m_tree.assign(size, 0);
+    for (UINT64 i = 0; i < live.size(); i++) {
+      m_last[live[i].first] = i;
+      mark(i, 1);
+    }
+    m_now = live.size();
+  }
+
+public:
+  StackDistanceProfiler(UINT32 blksz_log, UINT32 max_log)
+      : m_blksz_log(blksz_log), m_max_log(max_log), m_tree((1 << 20) + 1, 0), m_hist(max_log + 2, 0) {}
+
+  void access(UINT32 addr) {
+    UINT64 line = addr >> m_blksz_log;
+    m_total++;
+    auto it = m_last.find(line);
+    if (it == m_last.end()) {
+      m_cold++;
+    } else {
+      UINT64 distance = prefix(m_now) - prefix(it->second + 1);
+      UINT32 bin = 0;
+      while (bin <= m_max_log && distance >= (1UL << bin)) bin++;
+      m_hist[bin]++;
+      mark(it->second, -1);
+    }
+    if (m_now + 1 >= m_tree.size()) compact();
+    mark(m_now, 1);
+    m_last[line] = m_now++;
+  }
+
+  // Miss ratio curve, one point per power-of-two capacity
+  void record(vector<ResultRecord> &out) {
+    for (UINT32 k = 0; k <= m_max_log; k++) {
+      // Capacity 2^k lines hits every access with distance < 2^k, i.e. bins [0, k]
+      UINT64 misses = m_cold;
+      for (UINT32 b = k + 1; b < m_hist.size(); b++) misses += m_hist[b];
+      ResultRecord r;
+      r.add("kind", "FullAssoLRU").add("block_size_log", m_blksz_log).add("lines", 1UL << k)
+          .add("capacity_kib", (double) (1UL << (k + m_blksz_log)) / 0x400)
+          .add("accesses", m_total).add("misses", misses)
+          .add("miss_rate", m_total ? (double) misses / (double) m_total : 0.0);
+      out.push_back(r);
+    }
+  }
+};
+
+KNOB<string> KnobFormat(KNOB_MODE_WRITEONCE, "pintool", "format", "md",
+                        "result formats, any of md,json,csv; json/csv go to cacheModels-<program>.json/.csv");
+KNOB<UINT64> KnobSeed(KNOB_MODE_WRITEONCE, "pintool", "seed", "1",
+                      "seed of the random replacement of every model, 0 for the clock");
+KNOB<BOOL> KnobMrc(KNOB_MODE_WRITEONCE, "pintool", "mrc", "0", "profile the LRU miss-ratio curve of data accesses");
+KNOB<UINT32> KnobMrcBlock(KNOB_MODE_WRITEONCE, "pintool", "mrc_block", "6", "log2 of the line size of the curve");
+KNOB<UINT32> KnobMrcMax(KNOB_MODE_WRITEONCE, "pintool", "mrc_max", "16", "log2 of the largest capacity in lines");
+
+StackDistanceProfiler *mrc = nullptr;
+
+KNOB<BOOL> KnobICache(KNOB_MODE_WRITEONCE, "pintool", "icache", "0",
+                      "model instruction fetch: L1I models, L1I/L1D/L2 hierarchy and per-image footprint");
+
+const UINT32 FOOTPRINT_LINE_LOG = 6;
+
+string program;                         // Name of the analysed program, suffix of output files
 vector<CacheModel *> models;
+vector<CacheModel *> imodels;           // Instruction cache models
+CacheHierarchy *hierarchy = nullptr;
+vector<ImageFootprint> images;          // [0] collects code outside any image
+map<UINT32, UINT32> image_slots;        // IMG_Id -> index in images
+
+KNOB<BOOL> KnobAttribution(KNOB_MODE_WRITEONCE, "pintool", "attribution", "0",
+                           "attribute data misses of one model to instructions and heap allocation sites");
+KNOB<UINT32> KnobAttrModel(KNOB_MODE_WRITEONCE, "pintool", "attr_model", "0",
+                           "index of the model whose misses are attributed");
+KNOB<UINT32> KnobTopN(KNOB_MODE_WRITEONCE, "pintool", "top", "20", "rows in each attribution table");
+
+class MissStats {
+public:
+  UINT64 accesses = 0;
+  UINT64 misses = 0;
+  UINT64 allocs = 0;              // Allocation sites only
+  UINT64 bytes = 0;               // Allocation sites only
+
+  void count(bool hit) {
+    accesses++;
+    if (!hit) misses++;
+  }
+};
+
+/**
+ * Misses per instruction and per heap allocation site.
+ * Heap objects are tracked by hooking malloc/calloc/realloc/free like malloctrace,
+ * an object is owned by the call site of the allocation.
+ */
+class MissAttribution {
+  struct HeapObject {
+    ADDRINT size;
+    ADDRINT site;
+  };
+
+  map<ADDRINT, HeapObject> objects;                 // start address -> live object
+  ADDRINT pending_size = 0;                         // Allocation in flight
+  ADDRINT pending_site = 0;
+  int depth = 0;                                    // Allocators may call each other
+
+public:
+  unordered_map<ADDRINT, MissStats> pcs;
+  unordered_map<ADDRINT, MissStats> sites;
+  MissStats non_heap;
+
+  void access(ADDRINT pc, ADDRINT addr, bool hit) {
+    pcs[pc].count(hit);
+    auto it = objects.upper_bound(addr);
+    if (it != objects.begin()) {
+      --it;
+      if (addr < it->first + it->second.size) {
+        sites[it->second.site].count(hit);
+        return;
+      }
+    }
+    non_heap.count(hit);
+  }
+
+  void allocBefore(ADDRINT size, ADDRINT site) {
+    if (depth++) return;
+    pending_size = size;
+    pending_site = site;
+  }
+
+  void allocAfter(ADDRINT ret) {
+    if (--depth) return;
+    if (!ret || !pending_size) return;
+    objects[ret] = {pending_size, pending_site};
+    auto &s = sites[pending_site];
+    s.allocs++;
+    s.bytes += pending_size;
+  }
+
+  void release(ADDRINT ptr) {
+    if (!depth) objects.erase(ptr);
+  }
+};
+
+MissAttribution *attribution = nullptr;
+CacheModel *attr_model = nullptr;
+
+VOID MallocBefore(ADDRINT size, ADDRINT site) { attribution->allocBefore(size, site); }
+
+VOID CallocBefore(ADDRINT num, ADDRINT size, ADDRINT site) { attribution->allocBefore(num * size, site); }
+
+VOID ReallocBefore(ADDRINT ptr, ADDRINT size, ADDRINT site) {
+  attribution->release(ptr);
+  attribution->allocBefore(size, site);
+}
+
+VOID AllocAfter(ADDRINT ret) { attribution->allocAfter(ret); }
+
+VOID FreeBefore(ADDRINT ptr) { attribution->release(ptr); }
+
+// Heap tracking is needed outside the region as well, so it is not gated by ToolActive
+VOID Image(IMG img, VOID *v) {
+  RTN rtn = RTN_FindByName(img, "malloc");
+  if (RTN_Valid(rtn)) {
+    RTN_Open(rtn);
+    RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) MallocBefore,
+                   IARG_FUNCARG_ENTRYPOINT_VALUE, 0, IARG_RETURN_IP, IARG_END);
+    RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR) AllocAfter, IARG_FUNCRET_EXITPOINT_VALUE, IARG_END);
+    RTN_Close(rtn);
+  }
+  rtn = RTN_FindByName(img, "calloc");
+  if (RTN_Valid(rtn)) {
+    RTN_Open(rtn);
+    RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) CallocBefore,
+                   IARG_FUNCARG_ENTRYPOINT_VALUE, 0, IARG_FUNCARG_ENTRYPOINT_VALUE, 1, IARG_RETURN_IP, IARG_END);
+    RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR) AllocAfter, IARG_FUNCRET_EXITPOINT_VALUE, IARG_END);
+    RTN_Close(rtn);
+  }
+  rtn = RTN_FindByName(img, "realloc");
+  if (RTN_Valid(rtn)) {
+    RTN_Open(rtn);
+    RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) ReallocBefore,
+                   IARG_FUNCARG_ENTRYPOINT_VALUE, 0, IARG_FUNCARG_ENTRYPOINT_VALUE, 1, IARG_RETURN_IP, IARG_END);
+    RTN_InsertCall(rtn, IPOINT_AFTER, (AFUNPTR) AllocAfter, IARG_FUNCRET_EXITPOINT_VALUE, IARG_END);
+    RTN_Close(rtn);
+  }
+  rtn = RTN_FindByName(img, "free");
+  if (RTN_Valid(rtn)) {
+    RTN_Open(rtn);
+    RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) FreeBefore, IARG_FUNCARG_ENTRYPOINT_VALUE, 0, IARG_END);
+    RTN_Close(rtn);
+  }
+}
 
 // Cache reading analysis routine
 void readCache(UINT32 mem_addr) {
@@ -555,6 +899,8 @@ void readCache(UINT32 mem_addr) {
   for (auto &model: models) {
     model->readReq(mem_addr);
   }
+  if (hierarchy) hierarchy->read(mem_addr);
+  if (mrc) mrc->access(mem_addr);
 }
 
 // Cache writing analysis routine
@@ -563,24 +909,202 @@ void writeCache(UINT32 mem_addr) {
   for (auto &model: models) {
     model->writeReq(mem_addr);
   }
+  if (hierarchy) hierarchy->write(mem_addr);
+  if (mrc) mrc->access(mem_addr);
+}
+
+// Cache access analysis routines with miss attribution
+void readCacheAttr(ADDRINT pc, ADDRINT ea) {
+  UINT32 mem_addr = ((UINT32) ea >> 2) << 2;
+  for (auto &model: models) {
+    auto hit = model->readReq(mem_addr);
+    if (model == attr_model) attribution->access(pc, ea, hit);
+  }
+  if (hierarchy) hierarchy->read(mem_addr);
+  if (mrc) mrc->access(mem_addr);
+}
+
+void writeCacheAttr(ADDRINT pc, ADDRINT ea) {
+  UINT32 mem_addr = ((UINT32) ea >> 2) << 2;
+  for (auto &model: models) {
+    auto hit = model->writeReq(mem_addr);
+    if (model == attr_model) attribution->access(pc, ea, hit);
+  }
+  if (hierarchy) hierarchy->write(mem_addr);
+  if (mrc) mrc->access(mem_addr);
+}
+
+// Instruction fetch analysis routine: one access per line touched by the basic block
+void fetchCache(UINT32 addr, UINT32 size, UINT32 image) {
+  UINT32 last = addr + size - 1;
+  for (auto &model: imodels) {
+    auto blk_log = model->blockSizeLog();
+    for (UINT32 line = addr >> blk_log; line <= last >> blk_log; line++)
+      model->readReq(line << blk_log);
+  }
+  auto &footprint = images[image];
+  auto blk_log = hierarchy->l1i->blockSizeLog();
+  for (UINT32 line = addr >> blk_log; line <= last >> blk_log; line++) {
+    footprint.fetches++;
+    if (!hierarchy->fetch(line << blk_log)) footprint.misses++;
+  }
 }
 
 // Pin calls this function every time a new instruction is encountered
 VOID Instruction(INS ins, VOID *v) {
+  // Fast-forward outside the region and between SimPoint intervals
+  if (!ToolActive()) return;
+  if (attribution) {
+    if (INS_IsMemoryRead(ins))
+      INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) readCacheAttr, IARG_INST_PTR, IARG_MEMORYREAD_EA, IARG_END);
+    if (INS_IsMemoryWrite(ins))
+      INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) writeCacheAttr, IARG_INST_PTR, IARG_MEMORYWRITE_EA, IARG_END);
+    return;
+  }
   if (INS_IsMemoryRead(ins))
     INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) readCache, IARG_MEMORYREAD_EA, IARG_END);
   if (INS_IsMemoryWrite(ins))
     INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) writeCache, IARG_MEMORYWRITE_EA, IARG_END);
 }
 
+UINT32 imageSlot(ADDRINT addr) {
+  IMG img = IMG_FindByAddress(addr);
+  if (!IMG_Valid(img)) return 0;
+  auto it = image_slots.find(IMG_Id(img));
+  if (it != image_slots.end()) return it->second;
+  auto slot = (UINT32) images.size();
+  images.emplace_back(IMG_Name(img));
+  image_slots[IMG_Id(img)] = slot;
+  return slot;
+}
+
+// Pin calls this function every time a new trace is encountered
+VOID Trace(TRACE trace, VOID *v) {
+  if (!ToolActive()) return;
+  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    auto addr = BBL_Address(bbl);
+    auto size = BBL_Size(bbl);
+    auto slot = imageSlot(addr);
+    for (auto line = addr >> FOOTPRINT_LINE_LOG; line <= (addr + size - 1) >> FOOTPRINT_LINE_LOG; line++)
+      images[slot].lines.insert(line);
+    BBL_InsertCall(bbl, IPOINT_BEFORE, (AFUNPTR) fetchCache,
+                   IARG_UINT32, (UINT32) addr, IARG_UINT32, (UINT32) size, IARG_UINT32, slot, IARG_END);
+  }
+}
+
+FILE *ilog_fp = nullptr;
+
+// Instruction side results: L1I models, the hierarchy and footprints
+VOID FiniICache() {
+  fprintf(ilog_fp, "|              model              |  miss rate  |    size   |\n");
+  fprintf(ilog_fp, "| ------------------------------- |  ---------  | --------- |\n");
+  for (auto &model: imodels) {
+    fprintf(ilog_fp, "|%32s | %.8f%% | %5.2f KiB |\n", model->name.c_str(), 100 - model->statistics(),
+            (float) model->capacity() / 8 / 0x400);
+  }
+  fprintf(ilog_fp, "\n|            hierarchy            |  miss rate  |    size   |\n");
+  fprintf(ilog_fp, "| ------------------------------- |  ---------  | --------- |\n");
+  for (auto model: hierarchy->levels()) {
+    fprintf(ilog_fp, "|%32s | %.8f%% | %5.2f KiB |\n", model->name.c_str(), 100 - model->statistics(),
+            (float) model->capacity() / 8 / 0x400);
+  }
+  fprintf(ilog_fp, "\n|  footprint KiB |    fetches   | L1I misses | image\n");
+  fprintf(ilog_fp, "| -------------- | ------------ | ---------- | -----\n");
+  sort(images.begin(), images.end(),
+       [](auto &a, auto &b) { return a.lines.size() > b.lines.size(); });
+  for (auto &img: images) {
+    if (img.lines.empty()) continue;
+    fprintf(ilog_fp, "| %14.2f | %12lu | %10lu | %s\n",
+            (float) (img.lines.size() << FOOTPRINT_LINE_LOG) / 0x400, img.fetches, img.misses, img.name.c_str());
+  }
+  fclose(ilog_fp);
+  for (auto &model: imodels) delete model;
+  delete hierarchy;
+}
+
+// "routine (file:line)" of an instruction
+string symbolize(ADDRINT pc) {
+  string rtn = RTN_FindNameByAddress(pc);
+  INT32 line = 0;
+  string file;
+  PIN_GetSourceLocation(pc, nullptr, &line, &file);
+  if (rtn.empty()) rtn = "?";
+  if (!file.empty()) rtn += " (" + file.substr(file.rfind('/') + 1) + ":" + decstr(line) + ")";
+  return rtn;
+}
+
+FILE *alog_fp = nullptr;
+
+// Top-N delinquent instructions and allocation sites
+VOID FiniAttribution() {
+  auto top = [](unordered_map<ADDRINT, MissStats> &m) {
+    vector<pair<ADDRINT, MissStats>> v(m.begin(), m.end());
+    sort(v.begin(), v.end(), [](auto &a, auto &b) { return a.second.misses > b.second.misses; });
+    if (v.size() > KnobTopN.Value()) v.resize(KnobTopN.Value());
+    return v;
+  };
+  UINT64 total = attribution->non_heap.misses;
+  for (auto &s: attribution->sites) total += s.second.misses;
+  fprintf(alog_fp, "Misses of %s: %lu\n\n", attr_model->name.c_str(), total);
+  // 0 when the region had no misses
+  auto share = [total](UINT64 misses) { return total ? 100.0 * (double) misses / (double) total : 0.0; };
+
+  PIN_LockClient();
+  fprintf(alog_fp, "|          pc        |   accesses   |    misses    | miss rate | share  | location\n");
+  fprintf(alog_fp, "| ------------------ | ------------ | ------------ | --------- | ------ | --------\n");
+  for (auto &r: top(attribution->pcs)) {
+    auto &st = r.second;
+    fprintf(alog_fp, "| %#18lx | %12lu | %12lu | %8.4f%% | %5.2f%% | %s\n", r.first, st.accesses, st.misses,
+            100.0 * (double) st.misses / (double) st.accesses, share(st.misses),
+            symbolize(r.first).c_str());
+  }
+  fprintf(alog_fp, "\n| allocation site    | allocs |   MiB    |   accesses   |    misses    | share  | location\n");
+  fprintf(alog_fp, "| ------------------ | ------ | -------- | ------------ | ------------ | ------ | --------\n");
+  for (auto &r: top(attribution->sites)) {
+    auto &st = r.second;
+    fprintf(alog_fp, "| %#18lx | %6lu | %8.2f | %12lu | %12lu | %5.2f%% | %s\n", r.first, st.allocs,
+            (double) st.bytes / (1 << 20), st.accesses, st.misses, share(st.misses),
+            symbolize(r.first).c_str());
+  }
+  PIN_UnlockClient();
+  auto &nh = attribution->non_heap;
+  fprintf(alog_fp, "|     not on heap    |        |          | %12lu | %12lu | %5.2f%% | stack, globals\n",
+          nh.accesses, nh.misses, share(nh.misses));
+  fclose(alog_fp);
+  delete attribution;
+}
+
 // This function is called when the application exits
 VOID Fini(INT32 code, VOID *v) {
   Dbg("All finished.");
+  if (sampler.enabled()) {
+    auto scale = sampler.finish(control_icount);
+    for (auto &model: models) model->applyWeights(scale);
+    for (auto &model: imodels) model->applyWeights(scale);
+    if (hierarchy)
+      for (auto level: hierarchy->levels()) level->applyWeights(scale);
+  }
+  ControlReport(cerr);
+
+  auto formats = KnobFormat.Value();
+  ResultWriter writer("cacheModel", program);
+  for (auto &model: models) writer.section("results").push_back(model->record());
+  for (auto &model: imodels) writer.section("icache").push_back(model->record());
+  if (hierarchy)
+    for (auto level: hierarchy->levels()) writer.section("hierarchy").push_back(level->record());
+  if (mrc) mrc->record(writer.section("mrc"));
+  if (!writer.write(formats, "cacheModels-" + program))
+    Err("Cannot write results of formats %s", formats.c_str());
+  delete mrc;
+
+  if (hierarchy) FiniICache();
+  if (attribution) FiniAttribution();
   vector<pair<string, pair<float, size_t>>> results;
   for (auto &model: models) {
     results.emplace_back(model->name, pair(model->statistics(), model->capacity()));
     delete model;
   }
+  if (formats.find("md") == string::npos) return;
   // log_write("%26s == RANKING ==\n", " ");
   log_write("|              model              |  miss rate  |    size   |\n");
   log_write("| ------------------------------- |  ---------  | --------- |\n");
@@ -592,40 +1116,62 @@ VOID Fini(INT32 code, VOID *v) {
   }
 }
 
+// SimPoint interval callbacks
+VOID SampleBegin() {
+  for (auto &model: models) model->beginInterval();
+  for (auto &model: imodels) model->beginInterval();
+  if (hierarchy)
+    for (auto level: hierarchy->levels()) level->beginInterval();
+}
+
+VOID SampleEnd(double weight) {
+  for (auto &model: models) model->endInterval(weight);
+  for (auto &model: imodels) model->endInterval(weight);
+  if (hierarchy)
+    for (auto level: hierarchy->levels()) level->endInterval(weight);
+}
+
 INT32 Usage() {
   cerr << "This tool tests multiple models of caching" << endl;
   cerr << endl << KNOB_BASE::StringKnobSummary() << endl;
   return -1;
 }
 
-#define APPEND_TEST_MODEL(inst) do {   \
+#define APPEND_MODEL(list, inst) do {  \
   auto _p = (new inst);                \
-  models.emplace_back(_p);             \
+  (list).emplace_back(_p);             \
   _p->setName(#inst);                  \
 } while (0)
 
-#define APPEND_TEST_MODEL_REPLACE(inst, replace) do { \
-  auto _p = (new inst);                               \
-  models.emplace_back(_p);                            \
-  _p->setName(#inst "-" #replace);                    \
-  _p->setReplace([](auto i) {                         \
-      return new replace(i);                          \
-    });                                               \
+#define APPEND_MODEL_REPLACE(list, inst, replace) do { \
+  auto _p = (new inst);                                \
+  (list).emplace_back(_p);                             \
+  _p->setName(#inst "-" #replace);                     \
+  _p->setReplace([](auto i) {                          \
+      return new replace(i);                           \
+    });                                                \
   } while (0)
 
+#define APPEND_TEST_MODEL(inst) APPEND_MODEL(models, inst)
+#define APPEND_TEST_MODEL_REPLACE(inst, replace) APPEND_MODEL_REPLACE(models, inst, replace)
+#define APPEND_TEST_IMODEL(inst) APPEND_MODEL(imodels, inst)
+#define APPEND_TEST_IMODEL_REPLACE(inst, replace) APPEND_MODEL_REPLACE(imodels, inst, replace)
+
 FILE *log_fp = nullptr;
 
 // argc, argv are the entire command line, including pin -t <toolname> -- ...
 int main(int argc, char *argv[]) {
-  // Initialize pin
+  // Initialize pin, symbols are needed by -start_rtn/-stop_rtn
+  PIN_InitSymbols();
   if (PIN_Init(argc, argv)) return Usage();
 
-  srand(time(nullptr));
+  random_seed = KnobSeed.Value();
 
   auto last_arg = string(argv[argc - 1]);
   if (last_arg.find('/') != string::npos) {
     last_arg = last_arg.substr(last_arg.rfind('/') + 1);
   }
+  program = last_arg;
   auto filename = string("cacheModels-") + last_arg + ".txt";
 
   log_fp = fopen(filename.c_str(), "w");
@@ -700,8 +1246,49 @@ int main(int argc, char *argv[]) {
                   (float) limit_bits / 8 / 0x400, (float) m->capacity() / 8 / 0x400));
   }
 
+  if (KnobICache.Value()) {
+    auto ifilename = string("icacheModels-") + last_arg + ".txt";
+    ilog_fp = fopen(ifilename.c_str(), "w");
+    Dbg("Instruction cache models, log to file %s", ifilename.c_str());
+
+    APPEND_TEST_IMODEL(DirectMappingCache(256, 6));
+    APPEND_TEST_IMODEL(DirectMappingCache(512, 6));
+    APPEND_TEST_IMODEL_REPLACE(SetAsso_VIVT(6, 6, 4), LRURepl);
+    APPEND_TEST_IMODEL_REPLACE(SetAsso_VIVT(7, 6, 4), LRURepl);
+
+    // 32 KiB L1I and L1D, 256 KiB unified L2
+    auto l1i = new SetAsso_VIVT(7, 6, 4);
+    auto l1d = new SetAsso_VIVT(7, 6, 4);
+    auto l2 = new SetAsso_VIVT(10, 6, 4);
+    l1i->setName("L1I-SetAsso_VIVT(7, 6, 4)-LRURepl");
+    l1d->setName("L1D-SetAsso_VIVT(7, 6, 4)-LRURepl");
+    l2->setName("L2-SetAsso_VIVT(10, 6, 4)-LRURepl");
+    for (auto c: {l1i, l1d, l2}) c->setReplace([](auto i) { return new LRURepl(i); });
+    hierarchy = new CacheHierarchy(l1i, l1d, l2);
+    images.emplace_back("[unknown]");
+
+    TRACE_AddInstrumentFunction(Trace, nullptr);
+  }
+
+  if (KnobAttribution.Value()) {
+    Assert(KnobAttrModel.Value() < models.size(), "No model %u to attribute", KnobAttrModel.Value());
+    auto afilename = string("cacheMisses-") + last_arg + ".txt";
+    alog_fp = fopen(afilename.c_str(), "w");
+    Dbg("Miss attribution of %s, log to file %s", models[KnobAttrModel.Value()]->name.c_str(), afilename.c_str());
+    attribution = new MissAttribution;
+    attr_model = models[KnobAttrModel.Value()];
+    IMG_AddInstrumentFunction(Image, nullptr);
+  }
+
+  if (KnobMrc.Value()) mrc = new StackDistanceProfiler(KnobMrcBlock.Value(), KnobMrcMax.Value());
+
   Dbg("%lu models init done", models.size());
 
+  if (!ControlInit(SampleBegin, SampleEnd, Fini)) {
+    Err("Cannot load SimPoint files %s, %s", KnobSimPoints.Value().c_str(), KnobSimWeights.Value().c_str());
+    return 1;
+  }
+
   // Register Instruction to be called to instrument instructions
   INS_AddInstrumentFunction(Instruction, nullptr);
 
@@ -0,0 +1,63 @@
+//
+// Seedable pseudo-random numbers for the random policies of the models.
+//
+// Every model owns a Xoshiro256 (xoshiro256++), so results only depend on
+// the seed and models can run on different threads without sharing the libc
+// rand() state. Generators draw their seeds from random_seed in creation
+// order: set it before creating the models, from one thread.
+//
+#ifndef ARCH_LABS_PRNG_H
+#define ARCH_LABS_PRNG_H
+
+#include <cstdint>
+#include <ctime>
+
+// Seed of the next generator, 0 seeds from the clock
+static uint64_t random_seed = 1;
+
+class Xoshiro256 {
+  uint64_t m_s[4];
+
+  static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+  static uint64_t splitmix64(uint64_t &x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  // Distinct seed for every generator of a run
+  static uint64_t nextSeed() {
+    if (!random_seed) random_seed = (uint64_t) time(nullptr);
+    return splitmix64(random_seed);
+  }
+
+public:
+  Xoshiro256() { seed(nextSeed()); }
+
+  explicit Xoshiro256(uint64_t s) { seed(s); }
+
+  void seed(uint64_t s) {
+    for (auto &w: m_s) w = splitmix64(s);
+  }
+
+  uint64_t next() {
+    uint64_t r = rotl(m_s[0] + m_s[3], 23) + m_s[0];
+    uint64_t t = m_s[1] << 17;
+    m_s[2] ^= m_s[0];
+    m_s[3] ^= m_s[1];
+    m_s[1] ^= m_s[2];
+    m_s[0] ^= m_s[3];
+    m_s[2] ^= t;
+    m_s[3] = rotl(m_s[3], 45);
+    return r;
+  }
+
+  // Uniform in [0, n), by multiplication instead of a division
+  uint64_t below(uint64_t n) { return (uint64_t) (((unsigned __int128) next() * n) >> 64); }
+
+  bool coin() { return next() >> 63; }
+};
+
+#endif //ARCH_LABS_PRNG_H
@@ -0,0 +1,235 @@
+//
+// Region-of-interest control, shared by brchPredict and cacheModel.
+//
+// Instructions are counted per basic block all the time, the analysis calls
+// of the tool are only inserted inside the region (and inside the SimPoint
+// intervals when sampling). Whenever that changes the code cache is flushed
+// with PIN_RemoveInstrumentation, so code outside the region runs with the
+// counter only.
+//
+// The region starts after -skip instructions, or on the first entry of
+// -start_rtn, or on SSC mark -ssc_start ("mov ebx, <mark>; fs addr32 nop"),
+// and stops after -length instructions, on -stop_rtn or on SSC mark -ssc_stop.
+//
+#ifndef ARCH_LABS_REGION_H
+#define ARCH_LABS_REGION_H
+
+#include <iostream>
+#include <string>
+#include "pin.H"
+#include "simpoint.h"
+
+KNOB<UINT64> KnobSkip(KNOB_MODE_WRITEONCE, "pintool", "skip", "0",
+                      "instructions to fast-forward before the region (or before waiting for its trigger)");
+KNOB<UINT64> KnobLength(KNOB_MODE_WRITEONCE, "pintool", "length", "0",
+                        "instructions to simulate in the region, 0 for unlimited");
+KNOB<std::string> KnobStartRtn(KNOB_MODE_WRITEONCE, "pintool", "start_rtn", "",
+                               "start the region when this routine is entered");
+KNOB<std::string> KnobStopRtn(KNOB_MODE_WRITEONCE, "pintool", "stop_rtn", "",
+                              "stop the region when this routine is entered");
+KNOB<UINT32> KnobSscStart(KNOB_MODE_WRITEONCE, "pintool", "ssc_start", "0",
+                          "start the region on this SSC mark, 0 to disable");
+KNOB<UINT32> KnobSscStop(KNOB_MODE_WRITEONCE, "pintool", "ssc_stop", "0",
+                         "stop the region on this SSC mark, 0 to disable");
+KNOB<BOOL> KnobDetach(KNOB_MODE_WRITEONCE, "pintool", "detach", "1",
+                      "detach Pin once nothing is left to simulate (not with SimPoint), results are written on detach");
+
+class RegionControl {
+public:
+  enum State {
+    Skipping,     // Fast-forwarding -skip instructions
+    Armed,        // Waiting for the start routine or mark
+    Inside,
+    After
+  };
+
+private:
+  State m_state = Inside;
+  UINT64 m_skip = 0;
+  UINT64 m_length = 0;
+  bool m_triggered = false;     // Start on a routine or mark
+  UINT64 m_start = 0;           // icount at region start
+  UINT64 m_stop = 0;            // icount at region stop
+
+public:
+  void setup(UINT64 skip, UINT64 length, bool triggered) {
+    m_skip = skip;
+    m_length = length;
+    m_triggered = triggered;
+    m_state = skip ? Skipping : (triggered ? Armed : Inside);
+  }
+
+  bool active() const { return m_state == Inside; }
+
+  bool finished() const { return m_state == After; }
+
+  // Whether the region is limited at all
+  bool enabled() const { return m_skip || m_length || m_triggered; }
+
+  UINT64 nextEvent() const {
+    if (m_state == Skipping) return m_skip;
+    if (m_state == Inside && m_length) return m_start + m_length;
+    return ~0UL;
+  }
+
+  void advance(UINT64 icount) {
+    if (m_state == Skipping && icount >= m_skip) {
+      if (m_triggered) m_state = Armed;
+      else start(icount);
+    }
+    if (m_state == Inside && m_length && icount >= m_start + m_length) stop(icount);
+  }
+
+  // A trigger during -skip is ignored, advance() arms the region after it
+  void start(UINT64 icount) {
+    if (m_state != Armed) return;
+    m_state = Inside;
+    m_start = icount;
+  }
+
+  void stop(UINT64 icount) {
+    if (m_state != Inside) return;
+    m_state = After;
+    m_stop = icount;
+  }
+
+  void report(std::ostream &out, UINT64 icount) const {
+    UINT64 stop = m_state == After ? m_stop : icount;
+    if (m_state == Skipping || m_state == Armed)
+      out << "Region: never started, " << icount << " instructions executed" << std::endl;
+    else
+      out << "Region: instructions [" << m_start << ", " << stop << "), " << stop - m_start
+          << " simulated" << std::endl;
+  }
+};
+
+static RegionControl region;
+static UINT64 control_icount = 0;             // Instructions executed so far
+static UINT64 control_next_event = 0;         // control_icount at which region or sampler may change
+static bool control_active = true;            // Whether analysis calls of the tool are inserted
+static VOID (*control_fini)(INT32, VOID *) = nullptr;
+
+// Whether the tool should insert its analysis calls now
+static inline bool ToolActive() { return control_active; }
+
+static VOID ControlUpdate() {
+  control_next_event = std::min(region.nextEvent(), sampler.nextEvent());
+  bool active = region.active() && sampler.simulating();
+  if (active != control_active) {
+    control_active = active;
+    PIN_RemoveInstrumentation();
+  }
+  // Nothing more to simulate, let the program run natively. Not with
+  // SimPoint: its weights are scaled by the length of the whole run, so
+  // instructions are counted to the end.
+  if (KnobDetach.Value() && region.finished() && !control_active && !sampler.enabled()) {
+    control_next_event = ~0UL;
+    PIN_Detach();
+  }
+}
+
+static ADDRINT PIN_FAST_ANALYSIS_CALL ControlCount(UINT32 num_ins) {
+  control_icount += num_ins;
+  return control_icount >= control_next_event;
+}
+
+static VOID ControlEvent() {
+  region.advance(control_icount);
+  sampler.advance(control_icount);
+  ControlUpdate();
+}
+
+static VOID ControlStart() {
+  region.start(control_icount);
+  ControlUpdate();
+}
+
+static VOID ControlStop() {
+  region.stop(control_icount);
+  ControlUpdate();
+}
+
+// Value of the SSC mark at ins, or 0 if ins is not "fs addr32 nop" after "mov ebx, imm"
+static UINT32 SscMark(INS ins) {
+  if (INS_Size(ins) != 3) return 0;
+  UINT8 bytes[3];
+  if (PIN_SafeCopy(bytes, (VOID *) INS_Address(ins), 3) != 3) return 0;
+  if (bytes[0] != 0x64 || bytes[1] != 0x67 || bytes[2] != 0x90) return 0;
+  INS prev = INS_Prev(ins);
+  if (!INS_Valid(prev) || INS_Opcode(prev) != XED_ICLASS_MOV) return 0;
+  if (!INS_OperandIsReg(prev, 0) || INS_OperandReg(prev, 0) != REG_EBX || !INS_OperandIsImmediate(prev, 1)) return 0;
+  return (UINT32) INS_OperandImmediate(prev, 1);
+}
+
+static VOID ControlTrace(TRACE trace, VOID *v) {
+  bool ssc = KnobSscStart.Value() || KnobSscStop.Value();
+  for (BBL bbl = TRACE_BblHead(trace); BBL_Valid(bbl); bbl = BBL_Next(bbl)) {
+    BBL_InsertIfCall(bbl, IPOINT_BEFORE, (AFUNPTR) ControlCount, IARG_FAST_ANALYSIS_CALL,
+                     IARG_UINT32, BBL_NumIns(bbl), IARG_END);
+    BBL_InsertThenCall(bbl, IPOINT_BEFORE, (AFUNPTR) ControlEvent, IARG_END);
+    if (!ssc) continue;
+    for (INS ins = BBL_InsHead(bbl); INS_Valid(ins); ins = INS_Next(ins)) {
+      auto mark = SscMark(ins);
+      if (!mark) continue;
+      if (mark == KnobSscStart.Value())
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) ControlStart, IARG_END);
+      else if (mark == KnobSscStop.Value())
+        INS_InsertCall(ins, IPOINT_BEFORE, (AFUNPTR) ControlStop, IARG_END);
+    }
+  }
+}
+
+static VOID ControlImage(IMG img, VOID *v) {
+  if (!KnobStartRtn.Value().empty()) {
+    RTN rtn = RTN_FindByName(img, KnobStartRtn.Value().c_str());
+    if (RTN_Valid(rtn)) {
+      RTN_Open(rtn);
+      RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) ControlStart, IARG_END);
+      RTN_Close(rtn);
+    }
+  }
+  if (!KnobStopRtn.Value().empty()) {
+    RTN rtn = RTN_FindByName(img, KnobStopRtn.Value().c_str());
+    if (RTN_Valid(rtn)) {
+      RTN_Open(rtn);
+      RTN_InsertCall(rtn, IPOINT_BEFORE, (AFUNPTR) ControlStop, IARG_END);
+      RTN_Close(rtn);
+    }
+  }
+}
+
+// Pin does not call Fini after detaching
+static VOID ControlDetach(VOID *v) {
+  if (control_fini) control_fini(0, v);
+}
+
+/**
+ * Load region and SimPoint knobs and start counting instructions.
+ * Call after PIN_Init (with PIN_InitSymbols for -start_rtn/-stop_rtn).
+ * @param fini Fini of the tool, also called when Pin detaches
+ * @return false if the SimPoint files are invalid
+ */
+static bool ControlInit(SimPointSampler::BEGIN_CALLBACK begin, SimPointSampler::END_CALLBACK end,
+                        VOID (*fini)(INT32, VOID *)) {
+  if (!SimPointInit(begin, end)) return false;
+  bool triggered = !KnobStartRtn.Value().empty() || KnobSscStart.Value();
+  region.setup(KnobSkip.Value(), KnobLength.Value(), triggered);
+  region.advance(0);
+  control_active = region.active() && sampler.simulating();
+  control_next_event = std::min(region.nextEvent(), sampler.nextEvent());
+  control_fini = fini;
+
+  TRACE_AddInstrumentFunction(ControlTrace, nullptr);
+  if (!KnobStartRtn.Value().empty() || !KnobStopRtn.Value().empty())
+    IMG_AddInstrumentFunction(ControlImage, nullptr);
+  PIN_AddDetachFunction(ControlDetach, nullptr);
+  return true;
+}
+
+// Print what was simulated
+static VOID ControlReport(std::ostream &out) {
+  if (region.enabled()) region.report(out, control_icount);
+  if (sampler.enabled()) sampler.report(out, control_icount);
+}
+
+#endif //ARCH_LABS_REGION_H
@@ -0,0 +1,209 @@
+//
+// Machine-readable results (JSON / CSV) of the analysis tools.
+//
+// Every file carries RESULT_SCHEMA_VERSION. Bump it whenever a field is
+// renamed or its meaning changes; adding fields keeps the version.
+//
+#ifndef ARCH_LABS_RESULTS_H
+#define ARCH_LABS_RESULTS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <utility>
+
+#define RESULT_SCHEMA_VERSION 1
+
+/**
+ * One flat result row, fields are kept in insertion order
+ */
+class ResultRecord {
+  // key -> value already encoded as a JSON literal
+  std::vector<std::pair<std::string, std::string>> m_fields;
+
+public:
+  static std::string quote(const std::string &s) {
+    std::string r = "\"";
+    for (char c: s) {
+      if (c == '"' || c == '\\') r += '\\';
+      if ((unsigned char) c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        r += buf;
+      } else r += c;
+    }
+    return r + "\"";
+  }
+
+  // Inverse of quote() for a JSON string literal, other literals are returned as they are
+  static std::string unquote(const std::string &literal) {
+    if (literal.size() < 2 || literal[0] != '"') return literal;
+    std::string r;
+    for (size_t i = 1; i + 1 < literal.size(); i++) {
+      char c = literal[i];
+      if (c != '\\' || i + 2 >= literal.size()) {
+        r += c;
+        continue;
+      }
+      c = literal[++i];
+      if (c == 'u' && i + 4 < literal.size()) {
+        r += (char) strtol(literal.substr(i + 1, 4).c_str(), nullptr, 16);
+        i += 4;
+      } else r += c;
+    }
+    return r;
+  }
+
+  // RFC 4180 cell of a JSON literal: strings quoted with inner quotes doubled, numbers and booleans as they are
+  static std::string csvCell(const std::string &literal) {
+    if (literal.empty() || literal[0] != '"') return literal;
+    std::string r = "\"";
+    for (char c: unquote(literal)) {
+      if (c == '"') r += '"';
+      r += c;
+    }
+    return r + "\"";
+  }
+
+  ResultRecord &add(const std::string &key, const std::string &value) {
+    m_fields.emplace_back(key, quote(value));
+    return *this;
+  }
+
+  ResultRecord &add(const std::string &key, const char *value) { return add(key, std::string(value)); }
+
+  ResultRecord &add(const std::string &key, bool value) {
+    m_fields.emplace_back(key, value ? "true" : "false");
+    return *this;
+  }
+
+  ResultRecord &add(const std::string &key, uint64_t value) {
+    m_fields.emplace_back(key, std::to_string(value));
+    return *this;
+  }
+
+  ResultRecord &add(const std::string &key, uint32_t value) { return add(key, (uint64_t) value); }
+
+  ResultRecord &add(const std::string &key, int value) {
+    m_fields.emplace_back(key, std::to_string(value));
+    return *this;
+  }
+
+  ResultRecord &add(const std::string &key, double value) {
+    char buf[32];
+    // JSON has no NaN / Infinity
+    if (value != value || value > 1e300 || value < -1e300) {
+      m_fields.emplace_back(key, "null");
+      return *this;
+    }
+    snprintf(buf, sizeof(buf), "%.10g", value);
+    m_fields.emplace_back(key, buf);
+    return *this;
+  }
+
+  // Add all fields of another record, with keys prefixed
+  ResultRecord &merge(const ResultRecord &other, const std::string &prefix = "") {
+    for (auto &f: other.m_fields) m_fields.emplace_back(prefix + f.first, f.second);
+    return *this;
+  }
+
+  const std::vector<std::pair<std::string, std::string>> &fields() const { return m_fields; }
+
+  // Value of the first field named key without JSON quoting, empty if there is none
+  std::string text(const std::string &key) const {
+    for (auto &f: m_fields)
+      if (f.first == key) return unquote(f.second);
+    return "";
+  }
+
+  std::string json() const {
+    std::string r = "{";
+    for (size_t i = 0; i < m_fields.size(); i++) {
+      if (i) r += ", ";
+      r += quote(m_fields[i].first) + ": " + m_fields[i].second;
+    }
+    return r + "}";
+  }
+};
+
+/**
+ * Writes records of one run, grouped in named sections ("results", "mrc", ...)
+ */
+class ResultWriter {
+  std::string m_tool;
+  std::string m_program;
+  std::vector<std::pair<std::string, std::vector<ResultRecord>>> m_sections;
+
+public:
+  ResultWriter(std::string tool, std::string program) : m_tool(std::move(tool)), m_program(std::move(program)) {}
+
+  std::vector<ResultRecord> &section(const std::string &name) {
+    for (auto &s: m_sections)
+      if (s.first == name) return s.second;
+    m_sections.emplace_back(name, std::vector<ResultRecord>());
+    return m_sections.back().second;
+  }
+
+  bool writeJson(const std::string &filename) const {
+    FILE *fp = fopen(filename.c_str(), "w");
+    if (!fp) return false;
+    fprintf(fp, "{\n  \"schema_version\": %d,\n  \"tool\": %s,\n  \"program\": %s", RESULT_SCHEMA_VERSION,
+            ResultRecord::quote(m_tool).c_str(), ResultRecord::quote(m_program).c_str());
+    for (auto &s: m_sections) {
+      fprintf(fp, ",\n  %s: [", ResultRecord::quote(s.first).c_str());
+      for (size_t i = 0; i < s.second.size(); i++)
+        fprintf(fp, "%s\n    %s", i ? "," : "", s.second[i].json().c_str());
+      fprintf(fp, "\n  ]");
+    }
+    fprintf(fp, "\n}\n");
+    fclose(fp);
+    return true;
+  }
+
+  /**
+   * One CSV file per section: <base>.csv for "results", <base>.<section>.csv otherwise.
+   * Columns are the union of all keys, the first columns are schema_version and program.
+   */
+  bool writeCsv(const std::string &base) const {
+    for (auto &s: m_sections) {
+      auto filename = s.first == "results" ? base + ".csv" : base + "." + s.first + ".csv";
+      FILE *fp = fopen(filename.c_str(), "w");
+      if (!fp) return false;
+      std::vector<std::string> keys;
+      for (auto &r: s.second)
+        for (auto &f: r.fields())
+          if (std::find(keys.begin(), keys.end(), f.first) == keys.end()) keys.push_back(f.first);
+      fprintf(fp, "schema_version,program");
+      for (auto &k: keys) fprintf(fp, ",%s", k.c_str());
+      fprintf(fp, "\n");
+      for (auto &r: s.second) {
+        fprintf(fp, "%d,%s", RESULT_SCHEMA_VERSION, ResultRecord::csvCell(ResultRecord::quote(m_program)).c_str());
+        for (auto &k: keys) {
+          std::string v;
+          for (auto &f: r.fields())
+            if (f.first == k) v = f.second;
+          fprintf(fp, ",%s", ResultRecord::csvCell(v).c_str());
+        }
+        fprintf(fp, "\n");
+      }
+      fclose(fp);
+    }
+    return true;
+  }
+
+  /**
+   * Write according to a format list such as "md,json,csv" (md is left to the tool)
+   * @return false if a file cannot be written
+   */
+  bool write(const std::string &formats, const std::string &base) const {
+    bool ok = true;
+    if (formats.find("json") != std::string::npos) ok &= writeJson(base + ".json");
+    if (formats.find("csv") != std::string::npos) ok &= writeCsv(base);
+    return ok;
+  }
+};
+
+#endif //ARCH_LABS_RESULTS_H
@@ -0,0 +1,178 @@
+//
+// SimPoint-style sampled simulation, shared by brchPredict and cacheModel.
+//
+// The tool is fast-forwarded (instructions are only counted, see region.h)
+// between the representative intervals chosen by scripts/simpoint.py, and
+// every chosen interval is simulated in full. Counters of each interval are
+// weighted by the size of its cluster and scaled back to the whole run.
+//
+#ifndef ARCH_LABS_SIMPOINT_H
+#define ARCH_LABS_SIMPOINT_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "pin.H"
+
+KNOB<std::string> KnobSimPoints(KNOB_MODE_WRITEONCE, "pintool", "simpoints", "",
+                                "SimPoint .simpoints file, only simulate the chosen intervals");
+KNOB<std::string> KnobSimWeights(KNOB_MODE_WRITEONCE, "pintool", "weights", "",
+                                 "SimPoint .weights file matching -simpoints");
+KNOB<UINT64> KnobSimInterval(KNOB_MODE_WRITEONCE, "pintool", "interval", "10000000",
+                             "instructions per interval, must match the BBV profile");
+KNOB<UINT64> KnobSimWarmup(KNOB_MODE_WRITEONCE, "pintool", "warmup", "0",
+                           "instructions simulated before each interval without being counted");
+
+class SimPointSampler {
+public:
+  struct Point {
+    UINT64 interval;      // Index of the interval in the BBV profile
+    double weight;        // Fraction of all intervals represented by this one
+    UINT32 cluster;
+  };
+
+  enum State {
+    FastForward, Warmup, Measure, Done
+  };
+
+  typedef VOID (*BEGIN_CALLBACK)();
+  typedef VOID (*END_CALLBACK)(double weight);
+
+private:
+  std::vector<Point> m_points;
+  UINT64 m_interval = 0;
+  UINT64 m_warmup = 0;
+  UINT64 m_next_event = 0;      // icount at which the state changes next
+  size_t m_cur = 0;             // Current point
+  State m_state = Done;
+  bool m_enabled = false;
+  BEGIN_CALLBACK m_begin = nullptr;
+  END_CALLBACK m_end = nullptr;
+
+public:
+  bool enabled() const { return m_enabled; }
+
+  // Whether analysis calls of the tool should be inserted now
+  bool simulating() const { return !m_enabled || m_state == Warmup || m_state == Measure; }
+
+  UINT64 nextEvent() const { return m_state == Done ? ~0UL : m_next_event; }
+
+  const std::vector<Point> &points() const { return m_points; }
+
+  /**
+   * Load .simpoints ("interval cluster") and .weights ("weight cluster") files
+   * @return false if the files cannot be read or do not match
+   */
+  bool load(const std::string &points_file, const std::string &weights_file, UINT64 interval, UINT64 warmup) {
+    std::ifstream fp(points_file.c_str()), fw(weights_file.c_str());
+    if (!fp.is_open() || !fw.is_open() || interval == 0) return false;
+    std::vector<double> weights;
+    double w;
+    UINT32 cluster;
+    while (fw >> w >> cluster) {
+      if (weights.size() <= cluster) weights.resize(cluster + 1, -1);
+      weights[cluster] = w;
+    }
+    UINT64 index;
+    while (fp >> index >> cluster) {
+      if (cluster >= weights.size() || weights[cluster] < 0) return false;
+      m_points.push_back({index, weights[cluster], cluster});
+    }
+    if (m_points.empty()) return false;
+    std::sort(m_points.begin(), m_points.end(), [](const Point &a, const Point &b) {
+      return a.interval < b.interval;
+    });
+    m_interval = interval;
+    m_warmup = warmup;
+    m_enabled = true;
+    m_state = FastForward;
+    m_cur = 0;
+    m_next_event = warmStart(m_points[0]);
+    return true;
+  }
+
+  void setCallbacks(BEGIN_CALLBACK begin, END_CALLBACK end) {
+    m_begin = begin;
+    m_end = end;
+  }
+
+  /**
+   * Advance the state machine, called once icount reaches nextEvent()
+   * @param icount Instructions executed so far
+   * @return true if simulating() changed
+   */
+  bool advance(UINT64 icount) {
+    bool was_simulating = simulating();
+    while (m_state != Done && icount >= m_next_event) {
+      auto &p = m_points[m_cur];
+      UINT64 start = p.interval * m_interval;
+      switch (m_state) {
+        case FastForward:
+        case Warmup:
+          if (icount < start) {
+            m_state = Warmup;
+            m_next_event = start;
+          } else {
+            m_state = Measure;
+            m_next_event = start + m_interval;
+            if (m_begin) m_begin();
+          }
+          break;
+        case Measure:
+          if (m_end) m_end(p.weight);
+          if (++m_cur == m_points.size()) {
+            m_state = Done;
+          } else {
+            m_state = FastForward;
+            m_next_event = warmStart(m_points[m_cur]);
+          }
+          break;
+        default:
+          break;
+      }
+    }
+    return was_simulating != simulating();
+  }
+
+  /**
+   * Close a measured interval cut short by the end of the program
+   * @return Factor scaling weighted per-interval counters to the whole run
+   */
+  double finish(UINT64 icount) {
+    if (m_state == Measure) {
+      if (m_end) m_end(m_points[m_cur].weight);
+      m_state = Done;
+    }
+    return (double) icount / (double) m_interval;
+  }
+
+  void report(std::ostream &out, UINT64 icount) const {
+    out << "SimPoint: " << m_points.size() << " intervals of " << m_interval << " instructions, "
+        << m_cur << " simulated, " << icount << " instructions in total" << std::endl;
+  }
+
+private:
+  UINT64 warmStart(const Point &p) const {
+    UINT64 start = p.interval * m_interval;
+    return start > m_warmup ? start - m_warmup : 0;
+  }
+};
+
+static SimPointSampler sampler;
+
+/**
+ * Load the knobs, call after PIN_Init
+ * @return false if sampling was requested but the files are invalid
+ */
+static bool SimPointInit(SimPointSampler::BEGIN_CALLBACK begin, SimPointSampler::END_CALLBACK end) {
+  if (KnobSimPoints.Value().empty()) return true;
+  if (!sampler.load(KnobSimPoints.Value(), KnobSimWeights.Value(), KnobSimInterval.Value(), KnobSimWarmup.Value()))
+    return false;
+  sampler.setCallbacks(begin, end);
+  // The first interval may start at instruction 0
+  sampler.advance(0);
+  return true;
+}
+
+#endif //ARCH_LABS_SIMPOINT_H
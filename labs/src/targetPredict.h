@@ -0,0 +1,396 @@
+//
+// Branch target prediction, independent of Pin like brchPredict.h.
+//
+// Every executed control-flow instruction goes through TargetPredictor, which
+// predicts its target with the component matching its kind:
+//   cond, jump, call          BTB (set-associative, tagged, LRU)
+//   return                    RAS
+//   indirect, indirect_call   ITTAGE, falling back to its base table
+// Accuracy is counted per kind over taken branches, as only those need a target.
+//
+#ifndef ARCH_LABS_TARGET_PREDICT_H
+#define ARCH_LABS_TARGET_PREDICT_H
+
+#include "brchPredict.h"
+#include "brchTrace.h"
+
+/* ===================================================================== */
+/* Branch Target Buffer                                                  */
+/* ===================================================================== */
+class BTB {
+  struct Way {
+    bool valid = false;
+    ADDRINT tag = 0;
+    ADDRINT target = 0;
+    UINT64 lru = 0;               // Last access time
+  };
+
+  const size_t m_sets_log;
+  const size_t m_ways;
+  const size_t m_tag_width;
+  vector<Way> m_table;
+  UINT64 m_clock = 0;
+
+  ADDRINT tagOf(ADDRINT pc) const { return truncate(pc >> m_sets_log, m_tag_width); }
+
+  // The way holding pc, or the LRU way of its set on a miss
+  Way *find(ADDRINT pc, bool &hit) {
+    auto set = &m_table[truncate(pc, m_sets_log) * m_ways];
+    ADDRINT tag = tagOf(pc);
+    Way *victim = set;
+    for (size_t w = 0; w < m_ways; w++) {
+      if (set[w].valid && set[w].tag == tag) {
+        hit = true;
+        return &set[w];
+      }
+      if (!set[w].valid || (victim->valid && set[w].lru < victim->lru)) victim = &set[w];
+    }
+    hit = false;
+    return victim;
+  }
+
+public:
+  UINT64 lookups = 0;
+  UINT64 hits = 0;
+
+  // param:   sets_log:   log2 sets
+  //          ways:       Associativity
+  //          tag_width:  Partial tag bits
+  BTB(size_t sets_log = 9, size_t ways = 4, size_t tag_width = 16)
+          : m_sets_log(sets_log), m_ways(ways), m_tag_width(tag_width), m_table(((size_t) 1 << sets_log) * ways) {}
+
+  /**
+   * @return predicted target, 0 on a miss
+   */
+  ADDRINT predict(ADDRINT pc) {
+    bool hit;
+    lookups++;
+    auto way = find(pc, hit);
+    if (!hit) return 0;
+    hits++;
+    way->lru = ++m_clock;
+    return way->target;
+  }
+
+  void update(ADDRINT pc, ADDRINT target) {
+    bool hit;
+    auto way = find(pc, hit);
+    way->valid = true;
+    way->tag = tagOf(pc);
+    way->target = target;
+    way->lru = ++m_clock;
+  }
+
+  UINT32 capacity() const {
+    size_t lru_bits = 0;
+    while (((size_t) 1 << lru_bits) < m_ways) lru_bits++;
+    return (UINT32) ((m_table.size() * (1 + m_tag_width + sizeof(ADDRINT) * 8 + lru_bits)) / 8);
+  }
+
+  void config(ResultRecord &r, const string &prefix = "") const {
+    r.add(prefix + "sets_log", m_sets_log).add(prefix + "ways", m_ways).add(prefix + "tag_width", m_tag_width);
+  }
+};
+
+/* ===================================================================== */
+/* Return Address Stack                                                  */
+/* ===================================================================== */
+class ReturnAddressStack {
+  vector<ADDRINT> m_stack;
+  size_t m_top = 0;               // Next slot to push
+  size_t m_count = 0;
+
+public:
+  UINT64 overflows = 0;           // Pushes that overwrote the oldest address
+  UINT64 underflows = 0;          // Pops of an empty stack
+
+  explicit ReturnAddressStack(size_t depth = 32) : m_stack(depth, 0) {}
+
+  void push(ADDRINT addr) {
+    if (m_count == m_stack.size()) overflows++;
+    else m_count++;
+    m_stack[m_top] = addr;
+    m_top = (m_top + 1) % m_stack.size();
+  }
+
+  // @return predicted return address, 0 when empty
+  ADDRINT pop() {
+    if (m_count == 0) {
+      underflows++;
+      return 0;
+    }
+    m_count--;
+    m_top = (m_top + m_stack.size() - 1) % m_stack.size();
+    return m_stack[m_top];
+  }
+
+  UINT32 capacity() const { return (UINT32) (m_stack.size() * sizeof(ADDRINT)); }
+
+  void config(ResultRecord &r, const string &prefix = "") const { r.add(prefix + "depth", m_stack.size()); }
+};
+
+/* ===================================================================== */
+/* ITTAGE: indirect target predictor with geometric history lengths      */
+/* ===================================================================== */
+class ITTAGEPredictor {
+  struct Entry {
+    UINT16 tag = 0;
+    ADDRINT target = 0;
+    UINT8 ctr = 0;                // Confidence in target, 2 bits
+    UINT8 u = 0;                  // Usefulness, 2 bits
+  };
+
+  const size_t m_tnum;
+  const size_t m_base_log;
+  const size_t m_entries_log;
+  const size_t m_tag_width;
+  const size_t m_rst_period;
+  vector<ADDRINT> m_base;         // Last target per pc
+  vector<vector<Entry>> m_T;      // m_T[1 : m_tnum]
+  vector<size_t> m_hist_len;
+  HistoryRegister m_ghist;
+  vector<FoldedHistory> m_ci, m_ct0, m_ct1;
+  size_t m_rst_cnt = 0;
+
+  // State of the last prediction
+  vector<UINT32> m_gi;
+  vector<UINT16> m_gt;
+  UINT32 m_bi = 0;
+  size_t m_hit = 0, m_alt = 0;
+  ADDRINT m_alt_target = 0;
+  ADDRINT m_pred = 0;
+
+public:
+  // param:   tnum:               Tagged tables
+  //          base_entry_num_log: log2 entries of the base table
+  //          min_hist, max_hist: History lengths of T1 and T[tnum]
+  //          entry_num_log:      log2 entries of every tagged table
+  //          tag_width:          Tag bits
+  ITTAGEPredictor(size_t tnum = 6, size_t base_entry_num_log = 8, size_t min_hist = 4, size_t max_hist = 200,
+                  size_t entry_num_log = 8, size_t tag_width = 11, size_t rst_period = 256 * 1024)
+          : m_tnum(tnum), m_base_log(base_entry_num_log), m_entries_log(entry_num_log), m_tag_width(tag_width),
+            m_rst_period(rst_period), m_base((size_t) 1 << base_entry_num_log, 0), m_T(tnum + 1),
+            m_hist_len(tnum + 1, 0), m_ghist(max_hist), m_ci(tnum + 1), m_ct0(tnum + 1), m_ct1(tnum + 1),
+            m_gi(tnum + 1, 0), m_gt(tnum + 1, 0) {
+    for (size_t i = 1; i <= m_tnum; i++) {
+      double ratio = m_tnum > 1 ? (double) (i - 1) / (double) (m_tnum - 1) : 0;
+      m_hist_len[i] = (size_t) (min_hist * pow((double) max_hist / (double) min_hist, ratio) + 0.5);
+      m_T[i].resize((size_t) 1 << m_entries_log);
+      m_ci[i].init((int) m_hist_len[i], (int) m_entries_log);
+      m_ct0[i].init((int) m_hist_len[i], (int) m_tag_width);
+      m_ct1[i].init((int) m_hist_len[i], (int) m_tag_width - 1);
+    }
+  }
+
+  UINT32 capacity() const {
+    size_t bits = m_base.size() * sizeof(ADDRINT) * 8 +
+                  m_tnum * ((size_t) 1 << m_entries_log) * (m_tag_width + sizeof(ADDRINT) * 8 + 2 + 2) +
+                  m_hist_len[m_tnum];
+    return (UINT32) (bits / 8);
+  }
+
+  void config(ResultRecord &r, const string &prefix = "") const {
+    r.add(prefix + "tables", m_tnum).add(prefix + "base_entries_log", m_base_log)
+        .add(prefix + "entries_log", m_entries_log).add(prefix + "min_hist", m_hist_len[1])
+        .add(prefix + "max_hist", m_hist_len[m_tnum]).add(prefix + "tag_width", m_tag_width);
+  }
+
+  ADDRINT predict(ADDRINT pc) {
+    m_bi = truncate((UINT32) pc, m_base_log);
+    m_hit = m_alt = 0;
+    for (size_t i = m_tnum; i >= 1; i--) {
+      m_gi[i] = truncate((UINT32) (pc ^ (pc >> m_entries_log)) ^ m_ci[i].getVal(), m_entries_log);
+      m_gt[i] = (UINT16) truncate((UINT32) pc ^ m_ct0[i].getVal() ^ (m_ct1[i].getVal() << 1), m_tag_width);
+      if (m_T[i][m_gi[i]].tag != m_gt[i]) continue;
+      if (!m_hit) m_hit = i;
+      else if (!m_alt) m_alt = i;
+    }
+    m_alt_target = m_alt ? m_T[m_alt][m_gi[m_alt]].target : m_base[m_bi];
+    if (!m_hit) m_pred = m_base[m_bi];
+    else {
+      auto &e = m_T[m_hit][m_gi[m_hit]];
+      // A provider with no confidence yet defers to altpred
+      m_pred = (e.ctr == 0 && m_alt_target) ? m_alt_target : e.target;
+    }
+    return m_pred;
+  }
+
+  // Train with the actual target, call after predict with the same pc
+  void update(ADDRINT target) {
+    if (m_hit) {
+      auto &e = m_T[m_hit][m_gi[m_hit]];
+      if (e.target == target) {
+        if (e.ctr < 3) e.ctr++;
+        if (m_alt_target != target && e.u < 3) e.u++;
+      } else {
+        if (e.ctr > 0) e.ctr--;
+        else e.target = target;
+        if (m_alt_target == target && e.u > 0) e.u--;
+      }
+    }
+    if (!m_hit || m_base[m_bi] == 0 || m_pred != target) m_base[m_bi] = target;
+
+    if (m_pred != target && m_hit < m_tnum) {
+      bool allocated = false;
+      for (size_t i = m_hit + 1; i <= m_tnum; i++) {
+        auto &e = m_T[i][m_gi[i]];
+        if (e.u == 0) {
+          e.tag = m_gt[i];
+          e.target = target;
+          e.ctr = 0;
+          allocated = true;
+          break;
+        }
+      }
+      if (!allocated)
+        for (size_t i = m_hit + 1; i <= m_tnum; i++) {
+          auto &e = m_T[i][m_gi[i]];
+          if (e.u > 0) e.u--;
+        }
+    }
+
+    if (++m_rst_cnt == m_rst_period) {
+      m_rst_cnt = 0;
+      for (size_t i = 1; i <= m_tnum; i++)
+        for (auto &e: m_T[i]) e.u >>= 1;
+    }
+  }
+
+  // Every branch shifts one bit: the outcome of conditional ones, the parity of target bits of the others
+  void updateHistory(ADDRINT pc, bool taken, ADDRINT target, UINT8 kind) {
+    bool bit = kind == BranchCond ? taken : (__builtin_parityll((UINT64) ((target >> 2) & 0x3ff)) ^ ((pc >> 4) & 1));
+    m_ghist.shiftIn(bit);
+    for (size_t i = 1; i <= m_tnum; i++) {
+      m_ci[i].update(m_ghist);
+      m_ct0[i].update(m_ghist);
+      m_ct1[i].update(m_ghist);
+    }
+  }
+};
+
+/* ===================================================================== */
+/* Target prediction of all branch kinds                                 */
+/* ===================================================================== */
+class TargetPredictor {
+public:
+  struct KindStats {
+    UINT64 branches = 0;
+    UINT64 taken = 0;
+    UINT64 correct = 0;           // Taken branches with the right target
+  };
+
+private:
+  BTB m_btb;
+  ReturnAddressStack m_ras;
+  ITTAGEPredictor m_ittage;
+  KindStats m_stats[BranchOther + 1];
+
+public:
+  TargetPredictor(BTB btb = BTB(), ReturnAddressStack ras = ReturnAddressStack(),
+                  ITTAGEPredictor ittage = ITTAGEPredictor())
+          : m_btb(std::move(btb)), m_ras(std::move(ras)), m_ittage(std::move(ittage)) {}
+
+  static const char *component(UINT8 kind) {
+    switch (kind) {
+      case BranchReturn:
+        return "RAS";
+      case BranchIndirect:
+      case BranchIndirectCall:
+        return "ITTAGE";
+      default:
+        return "BTB";
+    }
+  }
+
+  /**
+   * Predict and train with one executed control-flow instruction
+   * @param size Instruction length, the return address of calls is pc + size
+   */
+  void access(ADDRINT pc, BOOL taken, ADDRINT target, UINT8 kind, UINT32 size) {
+    if (kind > BranchOther) kind = BranchOther;
+    auto &s = m_stats[kind];
+    s.branches++;
+    ADDRINT pred = 0;
+    switch (kind) {
+      case BranchReturn:
+        pred = m_ras.pop();
+        break;
+      case BranchIndirect:
+      case BranchIndirectCall:
+        pred = m_ittage.predict(pc);
+        m_ittage.update(target);
+        break;
+      default:
+        // Not-taken branches need no target, the BTB is trained with taken ones only
+        if (taken) {
+          pred = m_btb.predict(pc);
+          m_btb.update(pc, target);
+        }
+        break;
+    }
+    if (branchIsCall(kind)) m_ras.push(pc + size);
+    if (taken) {
+      s.taken++;
+      if (pred == target) s.correct++;
+    }
+    m_ittage.updateHistory(pc, taken, target, kind);
+  }
+
+  const KindStats &stats(UINT8 kind) const { return m_stats[kind]; }
+
+  UINT32 capacity() const { return m_btb.capacity() + m_ras.capacity() + m_ittage.capacity(); }
+
+  void config(ResultRecord &r) const {
+    r.add("kind", "TargetPredictor").add("capacity_bytes", capacity())
+        .add("capacity_kib", (double) capacity() / 1024.0);
+    m_btb.config(r, "btb.");
+    m_ras.config(r, "ras.");
+    m_ittage.config(r, "ittage.");
+    r.add("btb.lookups", m_btb.lookups).add("btb.hits", m_btb.hits).add("ras.overflows", m_ras.overflows)
+        .add("ras.underflows", m_ras.underflows);
+  }
+
+  // One row per branch kind
+  void records(vector<ResultRecord> &rows) const {
+    for (UINT8 k = 0; k <= BranchOther; k++) {
+      auto &s = m_stats[k];
+      if (!s.branches) continue;
+      ResultRecord r;
+      r.add("branch_kind", branchKindName(k)).add("predictor", component(k)).add("branches", s.branches)
+          .add("taken", s.taken).add("correct", s.correct)
+          .add("accuracy", s.taken ? (double) s.correct / (double) s.taken : 0.0);
+      rows.push_back(r);
+    }
+  }
+
+  void report(ostream &out) const {
+    out << "Target predictors: " << (double) capacity() / 1024.0 << " KiB" << endl;
+    for (UINT8 k = 0; k <= BranchOther; k++) {
+      auto &s = m_stats[k];
+      if (!s.branches) continue;
+      out << "target[" << branchKindName(k) << "] " << component(k) << " branches: " << s.branches
+          << ", taken: " << s.taken << ", correct: " << s.correct << ", accuracy: "
+          << (s.taken ? 100.0 * (double) s.correct / (double) s.taken : 0.0) << endl;
+    }
+    out << "BTB hits: " << m_btb.hits << " / " << m_btb.lookups << endl
+        << "RAS overflows: " << m_ras.overflows << ", underflows: " << m_ras.underflows << endl;
+  }
+};
+
+TargetPredictor *TP = nullptr;
+
+// Target predictors under test, shared by the pintool and the replay
+void AddTargetPredictor() {
+  TP = new TargetPredictor(BTB(9, 4, 16), ReturnAddressStack(32), ITTAGEPredictor(6, 8, 4, 200, 8, 11));
+}
+
+// Per-kind rows and the configuration, as sections of the structured results
+void RecordTargets(ResultWriter &writer) {
+  if (!TP) return;
+  TP->records(writer.section("targets"));
+  ResultRecord r;
+  TP->config(r);
+  writer.section("target_predictors").push_back(r);
+}
+
+#endif //ARCH_LABS_TARGET_PREDICT_H